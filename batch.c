@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "pool.h"
+#include "romimage.h"
+#include "manifest.h"
+#include "lockstep.h"
+
+/* Runs many independent invaders machines from the same ROM image on a
+   work-stealing thread pool. Each instance gets its own input stream on
+   port 1 (coin, start, fire, left, right from a generator seeded with
+   the instance number) and finishes with a digest of its RAM and
+   registers, so any thread count must reproduce the same digests.
+   With a warmup, one machine runs that many frames first and every
+   instance is forked from it copy-on-write, exploring different inputs
+   from the same point. With -l each job runs LOCKSTEP_LANES instances
+   together in lockstep (see lockstep.h) instead of one; the digests
+   must not change.
+   Usage: batch [-l] [instances] [frames] [threads] [warmup] */
+
+#define CPU_HZ              2000000
+#define HALF_FRAME_CYCLES   (CPU_HZ / 120)
+
+typedef struct Batch{
+    RomImage    *rom;           //image every machine maps copy-on-write
+    State8080   *parent;        //machine the instances fork from, or NULL
+    int         overshoot;      //cycles the parent ran past its last slice
+    int         frames;
+    int         instances;
+    uint64_t    *digests;
+    uint64_t    *instructions;
+    uint64_t    *steps;         //lockstep: vector steps, per job
+    uint64_t    *lane_steps;    //lockstep: instructions they ran, per job
+}Batch;
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+//FNV-1a over memory and the registers
+static uint64_t Digest(State8080* state)
+{
+    uint64_t h = 0xcbf29ce484222325ull;
+    uint8_t regs[] = { state->a, state->b, state->c, state->d, state->e,
+                       state->h, state->l, state->sp >> 8, state->sp & 0xff,
+                       state->pc >> 8, state->pc & 0xff };
+
+    for (int i = 0; i < 0x10000; i++)
+        h = (h ^ state->memory[i]) * 0x100000001b3ull;
+    for (size_t i = 0; i < sizeof(regs); i++)
+        h = (h ^ regs[i]) * 0x100000001b3ull;
+    return h;
+}
+
+static int CompareDigest(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static State8080* NewMachine(Batch *batch)
+{
+    State8080* state;
+    if (batch->parent)
+        state = Clone8080(batch->rom, batch->parent);
+    else
+    {
+        state = InitializeFromRom(batch->rom);
+        MachineAttach(state);
+    }
+    return state;
+}
+
+//fresh controls once per frame; bit 3 always reads high
+static void NextInput(State8080* state, uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    state->io.in[1] = 0x08 | ((*seed >> 16) & 0x75);
+}
+
+static void Finish(Batch *batch, int instance, State8080* state)
+{
+    batch->digests[instance] = Digest(state);
+    batch->instructions[instance] = state->instructions -
+                                    (batch->parent ? batch->parent->instructions : 0);
+    Free8080(state);
+}
+
+static void RunInstance(int job, void *ctx)
+{
+    Batch *batch = ctx;
+    State8080* state = NewMachine(batch);
+    uint32_t seed = (uint32_t) job * 2654435761u + 1;
+    int overshoot = batch->overshoot;
+
+    for (int i = 0; i < batch->frames * 2; i++)
+    {
+        if ((i & 1) == 0)
+            NextInput(state, &seed);
+        overshoot = Run8080(state, HALF_FRAME_CYCLES - overshoot);
+        MachineInterrupt(state, HALF_FRAME_CYCLES);
+    }
+    Finish(batch, job, state);
+}
+
+//the same for the group of instances starting at job * LOCKSTEP_LANES
+static void RunLockstep(int job, void *ctx)
+{
+    Batch *batch = ctx;
+    State8080* machines[LOCKSTEP_LANES];
+    uint32_t seeds[LOCKSTEP_LANES];
+    int first = job * LOCKSTEP_LANES;
+    int lanes = batch->instances - first;
+    if (lanes > LOCKSTEP_LANES)
+        lanes = LOCKSTEP_LANES;
+
+    for (int k = 0; k < lanes; k++)
+    {
+        machines[k] = NewMachine(batch);
+        seeds[k] = (uint32_t) (first + k) * 2654435761u + 1;
+    }
+    Lockstep8080* ls = LockstepCreate(machines, lanes);
+    //slice ends fall where Run8080 carrying the overshoot puts them
+    uint64_t end = machines[0]->cycles - batch->overshoot;
+
+    for (int i = 0; i < batch->frames * 2; i++)
+    {
+        if ((i & 1) == 0)
+            for (int k = 0; k < lanes; k++)
+                NextInput(machines[k], &seeds[k]);
+        end += HALF_FRAME_CYCLES;
+        LockstepRun(ls, end);
+        for (int k = 0; k < lanes; k++)
+            MachineInterrupt(machines[k], HALF_FRAME_CYCLES);
+    }
+    batch->steps[job] = ls->steps;
+    batch->lane_steps[job] = ls->lane_steps;
+    LockstepFree(ls);
+    for (int k = 0; k < lanes; k++)
+        Finish(batch, first + k, machines[k]);
+}
+
+int main(int argc, char**argv)
+{
+    int lockstep = (argc > 1 && strcmp(argv[1], "-l") == 0);
+    if (lockstep)
+    {
+        argc--;
+        argv++;
+    }
+    int instances = (argc > 1) ? atoi(argv[1]) : 1000;
+    int frames = (argc > 2) ? atoi(argv[2]) : 60;
+    int threads = (argc > 3) ? atoi(argv[3]) : PoolCpuCount();
+    int warmup = (argc > 4) ? atoi(argv[4]) : 0;
+    int jobs = lockstep ? (instances + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES : instances;
+
+    State8080* image = Initialize8080();
+    int rom_end = LoadManifest("invaders.roms", image->memory, 0, NULL);
+    if (rom_end < 0)
+        return 1;
+
+    Batch batch = { RomImageCreate(image->memory, rom_end), NULL, 0, frames, instances,
+                    calloc(instances, sizeof(uint64_t)),
+                    calloc(instances, sizeof(uint64_t)),
+                    calloc(jobs, sizeof(uint64_t)),
+                    calloc(jobs, sizeof(uint64_t)) };
+
+    if (warmup > 0)
+    {
+        State8080* parent = InitializeFromRom(batch.rom);
+        MachineAttach(parent);
+        int overshoot = 0;
+        for (int i = 0; i < warmup * 2; i++)
+        {
+            overshoot = Run8080(parent, HALF_FRAME_CYCLES - overshoot);
+            MachineInterrupt(parent, HALF_FRAME_CYCLES);
+        }
+        RomImageFree(batch.rom);
+        batch.rom = RomImageFork(parent);
+        batch.parent = parent;
+        batch.overshoot = overshoot;
+    }
+
+    double start = Now();
+    PoolRun(jobs, threads, lockstep ? RunLockstep : RunInstance, &batch);
+    double secs = Now() - start;
+
+    //fold in instance order so scheduling cannot change the result
+    uint64_t total = 0, digest = 0xcbf29ce484222325ull;
+    for (int i = 0; i < instances; i++)
+    {
+        total += batch.instructions[i];
+        digest = (digest ^ batch.digests[i]) * 0x100000001b3ull;
+    }
+    printf("%d instances x %d frames on %d threads\n", instances, frames, threads);
+    printf("%llu instructions in %.3f s, %.1f emulated MIPS\n",
+           (unsigned long long) total, secs, total / secs / 1e6);
+    printf("digest %016llx\n", (unsigned long long) digest);
+    if (lockstep)
+    {
+        uint64_t steps = 0, lane_steps = 0;
+        for (int i = 0; i < jobs; i++)
+        {
+            steps += batch.steps[i];
+            lane_steps += batch.lane_steps[i];
+        }
+        printf("%.2f of %d lanes busy per lockstep step\n",
+               steps ? (double) lane_steps / steps : 0.0, LOCKSTEP_LANES);
+    }
+
+    //how many different places the inputs led to
+    int distinct = 0;
+    qsort(batch.digests, instances, sizeof(uint64_t), CompareDigest);
+    for (int i = 0; i < instances; i++)
+        distinct += (i == 0 || batch.digests[i] != batch.digests[i - 1]);
+    printf("%d distinct end states\n", distinct);
+
+    if (batch.parent)
+        Free8080(batch.parent);
+    RomImageFree(batch.rom);
+    free(batch.digests);
+    free(batch.instructions);
+    free(batch.steps);
+    free(batch.lane_steps);
+    Free8080(image);
+    return 0;
+}
@@ -0,0 +1,466 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.h"
+#include "jit.h"
+#include "manifest.h"
+#include "video.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Runs the invaders ROMs from reset for the same number of emulated
+   frames on each interpreter core and compares the wall-clock time.
+   Usage: bench [frames]   (default 600, ten seconds of game time)
+          bench parity     flag-table micro-benchmark, no ROMs needed
+          bench video      framebuffer renderer frames per second
+          bench suite [--json] [mcycles]
+                           per-class microbenchmarks and whole-ROM runs on
+                           every core: MIPS, ns per instruction and host
+                           IPC from perf counters where the kernel allows,
+                           as a table or one JSON object per line */
+
+#define CPU_HZ              2000000
+#define HALF_FRAME_CYCLES   (CPU_HZ / 120)
+
+typedef int (*RunFunc)(State8080* state, int cycles);
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static State8080* LoadInvaders(void)
+{
+    State8080* state = Initialize8080();
+    if (LoadManifest("invaders.roms", state->memory, 0, NULL) < 0)
+        exit(1);
+    MachineAttach(state);
+    return state;
+}
+
+static double Measure(RunFunc run, int frames, State8080* state)
+{
+    int overshoot = 0;
+    double start = Now();
+    for (int i = 0; i < frames * 2; i++)
+        overshoot = run(state, HALF_FRAME_CYCLES - overshoot);
+    return Now() - start;
+}
+
+static void Report(const char* name, double secs, State8080* state)
+{
+    printf("%-9s %8.3f s  %9.1f emulated MHz\n", name, secs,
+           state->cycles / secs / 1e6);
+}
+
+//the shift-and-count Parity() the core used before the flag table
+static int ParityLoop(int x, int size)
+{
+    int p=0;
+    x = (x & ((1<<size)-1));
+    for (int i=0; i < size; i++ ){
+        if (x& 0x1) p++;
+        x = (x>>1);
+    }
+    return (0 == (p & 0x1));
+}
+
+//each variant yields Z, S and P for every byte value, as SyncFlags needs
+static void BenchParity(void)
+{
+    const int rounds = 1 << 18;
+    volatile uint32_t sink;
+    uint32_t sum;
+    double start;
+
+    sum = 0;
+    start = Now();
+    for (int r = 0; r < rounds; r++)
+        for (int x = 0; x < 256; x++)
+            sum += (x == 0) | ((x & 0x80) != 0) << 1 | ParityLoop(x ^ r, 8) << 2;
+    double tloop = Now() - start;
+    sink = sum;
+
+    sum = 0;
+    start = Now();
+    for (int r = 0; r < rounds; r++)
+        for (int x = 0; x < 256; x++)
+            sum += zsp8080[(x ^ r) & 0xff];
+    double ttable = Now() - start;
+    sink = sum;
+    (void) sink;
+
+    double n = (double) rounds * 256;
+    printf("bit loop  %6.2f ns/result\n", tloop / n * 1e9);
+    printf("table     %6.2f ns/result\n", ttable / n * 1e9);
+}
+
+static int Diverged(State8080* x, State8080* y)
+{
+    return x->cycles != y->cycles || x->pc != y->pc || x->sp != y->sp ||
+           x->a != y->a || memcmp(x->memory, y->memory, 0x10000) != 0;
+}
+
+//render a screenful of noise over and over
+static void BenchVideo(void)
+{
+    const int frames = 20000;
+    static uint8_t memory[0x10000];
+    static uint8_t gray[VIDEO_WIDTH * VIDEO_HEIGHT];
+    static uint32_t rgba[VIDEO_WIDTH * VIDEO_HEIGHT];
+    uint32_t seed = 1;
+
+    for (int i = 0; i < 0x10000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        memory[i] = seed >> 16;
+    }
+
+    double start = Now();
+    for (int i = 0; i < frames; i++)
+        VideoGray(memory, gray);
+    double tgray = Now() - start;
+
+    start = Now();
+    for (int i = 0; i < frames; i++)
+        VideoRGBA(memory, rgba);
+    double trgba = Now() - start;
+
+    //a typical frame only rewrites a few lines of the screen
+    State8080* state = Initialize8080();
+    uint32_t lines[VIDEO_WORDS];
+    VideoTrack(state);
+    start = Now();
+    for (int i = 0; i < frames; i++)
+    {
+        for (int j = 0; j < 16; j++)
+        {
+            seed = seed * 1103515245 + 12345;
+            WriteMem(state, 0x2400 + (i * 97 + j) % 0x1c00, seed >> 16);
+        }
+        VideoTakeDirty(state, lines);
+        VideoGrayLines(state->memory, gray, lines);
+    }
+    double tdirty = Now() - start;
+    Free8080(state);
+
+    printf("gray      %8.3f s  %9.0f frames/s\n", tgray, frames / tgray);
+    printf("rgba      %8.3f s  %9.0f frames/s\n", trgba, frames / trgba);
+    printf("dirty     %8.3f s  %9.0f frames/s\n", tdirty, frames / tdirty);
+}
+
+/* Host cycle and instruction counters for the IPC column. Either can
+   be missing (no perf_event_open, paranoid settings, a VM without a
+   PMU), in which case the IPC is reported as unknown. */
+typedef struct Counters{
+    int         cycles;
+    int         insns;
+}Counters;
+
+#if defined(__linux__)
+static int PerfOpen(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = (group == -1);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void CountersStart(Counters *c)
+{
+    c->cycles = PerfOpen(PERF_COUNT_HW_CPU_CYCLES, -1);
+    c->insns = c->cycles >= 0 ? PerfOpen(PERF_COUNT_HW_INSTRUCTIONS, c->cycles) : -1;
+    if (c->insns >= 0)
+    {
+        ioctl(c->cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(c->cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+//host instructions per cycle since CountersStart, or -1
+static double CountersStop(Counters *c)
+{
+    uint64_t cycles = 0, insns = 0;
+    double ipc = -1;
+    if (c->insns >= 0)
+    {
+        ioctl(c->cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (read(c->cycles, &cycles, 8) == 8 && read(c->insns, &insns, 8) == 8 && cycles)
+            ipc = (double) insns / cycles;
+        close(c->insns);
+    }
+    if (c->cycles >= 0)
+        close(c->cycles);
+    return ipc;
+}
+#else
+static void CountersStart(Counters *c)
+{
+}
+
+static double CountersStop(Counters *c)
+{
+    return -1;
+}
+#endif
+
+//a loop over one class of instructions, loaded at 0 in a bare machine
+typedef struct Program{
+    const char  *name;
+    uint8_t     code[96];
+    int         len;
+}Program;
+
+static const Program programs[] = {
+    { "alu", {
+        0x06, 0x00,                 //MVI B,0
+        0x80, 0x81, 0xa7, 0xaf,     //ADD B; ADD C; ANA A; XRA A
+        0xe6, 0x5a, 0xfe, 0x33,     //ANI 5a; CPI 33
+        0x05, 0x19, 0x0f, 0x1f,     //DCR B; DAD D; RRC; RAR
+        0x80, 0x81, 0xa7, 0xaf,
+        0xe6, 0x5a, 0xfe, 0x33,
+        0x05, 0x19, 0x0f, 0x1f,
+        0xc3, 0x02, 0x00,           //JMP 2
+      }, 29 },
+    { "loadstore", {
+        0x21, 0x00, 0x24,           //LXI H,2400
+        0x11, 0x00, 0x25,           //LXI D,2500
+        0x3e, 0x12, 0x77, 0x7e,     //MVI A,12; MOV M,A; MOV A,M
+        0x1a, 0x32, 0x00, 0x26,     //LDAX D; STA 2600
+        0x3a, 0x01, 0x26, 0x5e,     //LDA 2601; MOV E,M
+        0x36, 0x55, 0xeb, 0xeb,     //MVI M,55; XCHG; XCHG
+        0x56, 0x7a, 0x7e, 0x77,     //MOV D,M; MOV A,D; MOV A,M; MOV M,A
+        0xc3, 0x06, 0x00,           //JMP 6
+      }, 29 },
+    { "branch", {
+        0x06, 0x00,                 //MVI B,0
+        0x05, 0xc2, 0x06, 0x00,     //DCR B; JNZ next
+        0x05, 0xc2, 0x0a, 0x00,
+        0x05, 0xc2, 0x0e, 0x00,
+        0x05, 0xc2, 0x12, 0x00,
+        0xc3, 0x15, 0x00,           //JMP next
+        0xc3, 0x18, 0x00,
+        0xc3, 0x1b, 0x00,
+        0xc3, 0x1e, 0x00,
+        0xc3, 0x02, 0x00,           //JMP 2
+      }, 33 },
+    { "stack", {
+        0x31, 0x00, 0x24,           //LXI SP,2400
+        0xc5, 0xd5, 0xe5,           //PUSH B; PUSH D; PUSH H
+        0xe1, 0xd1, 0xc1,           //POP H; POP D; POP B
+        0xcd, 0x10, 0x00,           //CALL 10
+        0xc3, 0x03, 0x00,           //JMP 3
+        0x00,
+        0xc5, 0xc1, 0xc9,           //PUSH B; POP B; RET
+      }, 19 },
+};
+
+enum { CORE_SWITCH, CORE_THREADED, CORE_PREDECODE, CORE_JIT, CORES };
+static const char *core_names[CORES] = { "switch", "threaded", "predecode", "jit" };
+
+static State8080* CoreMachine(int core)
+{
+    State8080* state = Initialize8080();
+#if USE_COMPUTED_GOTO
+    if (core == CORE_PREDECODE)
+        state->decoded = PredecodeCreate();
+#endif
+    if (core == CORE_JIT)
+        state->jit = JitCreate();
+    return state;
+}
+
+static int CoreAvailable(int core)
+{
+    if (core == CORE_THREADED || core == CORE_PREDECODE)
+        return USE_COMPUTED_GOTO;
+    if (core == CORE_JIT)
+    {
+        Jit8080 *jit = JitCreate();
+        JitFree(jit);
+        return jit != NULL;
+    }
+    return 1;
+}
+
+static void RunCoreDirect(int core, State8080* state, int cycles)
+{
+    switch (core)
+    {
+        case CORE_SWITCH:       Run8080Switch(state, cycles); break;
+#if USE_COMPUTED_GOTO
+        case CORE_THREADED:     Run8080Threaded(state, cycles); break;
+        case CORE_PREDECODE:    Run8080Predecoded(state, cycles); break;
+#endif
+        case CORE_JIT:          JitRun(state, cycles); break;
+    }
+}
+
+//Run8080 with interrupts, on the given core; Run8080 itself picks the
+//threaded core over the switch one when both are built
+static void RunMachine(int core, State8080* state, int cycles)
+{
+    if (core != CORE_SWITCH)
+    {
+        Run8080(state, cycles);
+        return;
+    }
+    uint64_t end = state->cycles + cycles;
+    while (state->cycles < end)
+    {
+        Accept8080(state);
+        if (state->halted)
+        {
+            state->cycles = end;
+            break;
+        }
+        state->stop = 0;
+        Run8080Switch(state, (int) (end - state->cycles));
+    }
+    state->stop = 0;
+}
+
+static void Result(int json, const char *bench, const char *core, State8080* state,
+                   double secs, double ipc)
+{
+    double mips = state->instructions / secs / 1e6;
+    double ns = secs * 1e9 / state->instructions;
+    if (json)
+    {
+        printf("{\"bench\":\"%s\",\"core\":\"%s\",\"instructions\":%llu,"
+               "\"cycles\":%llu,\"seconds\":%.6f,\"mips\":%.2f,\"ns_per_insn\":%.3f,",
+               bench, core, (unsigned long long) state->instructions,
+               (unsigned long long) state->cycles, secs, mips, ns);
+        if (ipc < 0)
+            printf("\"ipc\":null}\n");
+        else
+            printf("\"ipc\":%.3f}\n", ipc);
+    }
+    else
+    {
+        printf("%-10s %-10s %10.1f MIPS %8.2f ns/insn", bench, core, mips, ns);
+        if (ipc < 0)
+            printf("   IPC -\n");
+        else
+            printf("   IPC %.2f\n", ipc);
+    }
+}
+
+static void BenchSuite(int json, long mcycles)
+{
+    Counters counters;
+
+    for (size_t p = 0; p < sizeof(programs) / sizeof(programs[0]); p++)
+        for (int core = 0; core < CORES; core++)
+        {
+            if (!CoreAvailable(core))
+                continue;
+            State8080* state = CoreMachine(core);
+            memcpy(state->memory, programs[p].code, programs[p].len);
+
+            CountersStart(&counters);
+            double start = Now();
+            for (long m = 0; m < mcycles; m++)
+                RunCoreDirect(core, state, 1000000);
+            double secs = Now() - start;
+            Result(json, programs[p].name, core_names[core], state, secs, CountersStop(&counters));
+            Free8080(state);
+        }
+
+    //the game itself, with interrupts
+    int frames = mcycles * 1000000 / (2 * HALF_FRAME_CYCLES);
+    for (int core = 0; core < CORES; core++)
+    {
+        if (!CoreAvailable(core))
+            continue;
+        State8080* state = CoreMachine(core);
+        uint8_t rom_pages[256] = { 0 };
+        if (LoadManifest("invaders.roms", state->memory, 0, rom_pages) < 0)
+            exit(1);
+        for (int page = 0; page < 256; page++)
+            if (rom_pages[page])
+                ProtectRom(state, page << 8, (page + 1) << 8);
+        MachineAttach(state);
+
+        CountersStart(&counters);
+        double start = Now();
+        for (int i = 0; i < frames * 2; i++)
+        {
+            RunMachine(core, state, HALF_FRAME_CYCLES - state->cycles % HALF_FRAME_CYCLES);
+            MachineInterrupt(state, HALF_FRAME_CYCLES);
+        }
+        double secs = Now() - start;
+        Result(json, "invaders", core_names[core], state, secs, CountersStop(&counters));
+        Free8080(state);
+    }
+}
+
+int main(int argc, char**argv)
+{
+    if (argc > 1 && strcmp(argv[1], "parity") == 0)
+    {
+        BenchParity();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "video") == 0)
+    {
+        BenchVideo();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "suite") == 0)
+    {
+        int json = 0;
+        long mcycles = 100;
+        for (int i = 2; i < argc; i++)
+        {
+            if (strcmp(argv[i], "--json") == 0)
+                json = 1;
+            else
+                mcycles = atol(argv[i]);
+        }
+        BenchSuite(json, mcycles);
+        return 0;
+    }
+
+    int frames = (argc > 1) ? atoi(argv[1]) : 600;
+
+    State8080* sw = LoadInvaders();
+    double tsw = Measure(Run8080Switch, frames, sw);
+    Report("switch", tsw, sw);
+
+#if USE_COMPUTED_GOTO
+    State8080* th = LoadInvaders();
+    double tth = Measure(Run8080Threaded, frames, th);
+    Report("threaded", tth, th);
+    printf("speedup   %8.2fx\n", tsw / tth);
+
+    State8080* pd = LoadInvaders();
+    pd->decoded = PredecodeCreate();
+    double tpd = Measure(Run8080Predecoded, frames, pd);
+    Report("predecode", tpd, pd);
+    printf("speedup   %8.2fx\n", tsw / tpd);
+
+    //all cores must land on the same machine state
+    if (Diverged(sw, th) || Diverged(sw, pd))
+    {
+        printf("error: cores diverged\n");
+        return 1;
+    }
+#else
+    printf("threaded core not built (no computed goto)\n");
+#endif
+    return 0;
+}
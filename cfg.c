@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.h"
+#include "disasm.h"
+#include "cfg.h"
+
+enum { FLOW_NEXT, FLOW_JUMP, FLOW_BRANCH, FLOW_CALL, FLOW_RETURN, FLOW_RETURN_IF, FLOW_INDIRECT };
+
+//how an instruction passes control on
+static int Flow(uint8_t op)
+{
+    if (op == 0xc3 || op == 0xcb)
+        return FLOW_JUMP;
+    if (op == 0xc9 || op == 0xd9)
+        return FLOW_RETURN;
+    if (op == 0xe9)
+        return FLOW_INDIRECT;
+    if ((op & 0xcf) == 0xcd || (op & 0xc7) == 0xc4 || (op & 0xc7) == 0xc7)
+        return FLOW_CALL;
+    if ((op & 0xc7) == 0xc2)
+        return FLOW_BRANCH;
+    if ((op & 0xc7) == 0xc0)
+        return FLOW_RETURN_IF;
+    return FLOW_NEXT;
+}
+
+static uint16_t Target(const uint8_t *memory, uint16_t pc)
+{
+    uint8_t op = memory[pc];
+    if ((op & 0xc7) == 0xc7)
+        return op & 0x38;
+    return memory[(uint16_t) (pc + 1)] | memory[(uint16_t) (pc + 2)] << 8;
+}
+
+typedef struct Work{
+    uint16_t    *stack;
+    int         top;
+}Work;
+
+//queues a target unless it is outside the ROM
+static void Reach(Cfg8080 *cfg, Work *work, uint32_t adr, uint8_t how)
+{
+    cfg->marks[adr] |= how;
+    if (adr >= cfg->rom_end)
+    {
+        cfg->marks[adr] |= BLOCK_OUTSIDE;
+        return;
+    }
+    cfg->marks[adr] |= BLOCK_LEADER;
+    if (cfg->map[adr] == CFG_DATA)
+        work->stack[work->top++] = adr;
+    else if (cfg->map[adr] == CFG_OPERAND)
+        cfg->overlaps++;
+}
+
+//decodes straight on from adr until control leaves or meets decoded code
+static void Trace(Cfg8080 *cfg, Work *work, const uint8_t *memory, uint32_t pc)
+{
+    while (pc < cfg->rom_end && cfg->map[pc] == CFG_DATA)
+    {
+        uint8_t op = memory[pc];
+        uint32_t len = lengths8080[op];
+        if (pc + len > cfg->rom_end)
+            return;
+        for (uint32_t i = 1; i < len; i++)
+            if (cfg->map[pc + i] != CFG_DATA)
+            {
+                cfg->overlaps++;
+                return;
+            }
+        cfg->map[pc] = CFG_OPCODE;
+        for (uint32_t i = 1; i < len; i++)
+            cfg->map[pc + i] = CFG_OPERAND;
+
+        uint32_t next = pc + len;
+        switch (Flow(op))
+        {
+            case FLOW_JUMP:
+                Reach(cfg, work, Target(memory, pc), BLOCK_JUMPED);
+                return;
+            case FLOW_RETURN:
+            case FLOW_INDIRECT:
+                return;
+            case FLOW_BRANCH:
+                Reach(cfg, work, Target(memory, pc), BLOCK_JUMPED);
+                break;
+            case FLOW_CALL:
+                Reach(cfg, work, Target(memory, pc), BLOCK_CALLED);
+                break;
+        }
+        //whatever follows a branch, call or conditional return starts a block
+        if (Flow(op) != FLOW_NEXT && next < cfg->rom_end)
+            cfg->marks[next] |= BLOCK_LEADER;
+        pc = next;
+    }
+    if (pc < cfg->rom_end && cfg->map[pc] == CFG_OPCODE)
+        cfg->marks[pc] |= BLOCK_LEADER;
+    else if (pc < cfg->rom_end && cfg->map[pc] == CFG_OPERAND)
+        cfg->overlaps++;
+}
+
+//where control may go from the last instruction of a block
+static void Successors(Cfg8080 *cfg, CfgBlock *b, const uint8_t *memory, uint16_t last)
+{
+    uint8_t op = memory[last];
+    uint32_t next = last + lengths8080[op];
+    int flow = Flow(op);
+    uint32_t succ[2];
+    int n = 0;
+
+    b->call = -1;
+    if (flow == FLOW_JUMP || flow == FLOW_BRANCH)
+        succ[n++] = Target(memory, last);
+    if (flow == FLOW_CALL)
+        b->call = Target(memory, last);
+    if (flow != FLOW_JUMP && flow != FLOW_RETURN && flow != FLOW_INDIRECT)
+        succ[n++] = next;
+
+    b->nsucc = 0;
+    for (int i = 0; i < n; i++)
+        if (succ[i] < cfg->rom_end && cfg->map[succ[i]] == CFG_OPCODE)
+            b->succ[b->nsucc++] = succ[i];
+}
+
+Cfg8080* CfgAnalyse(const uint8_t *memory, uint32_t rom_end)
+{
+    Cfg8080 *cfg = calloc(1, sizeof(Cfg8080));
+    //each decoded instruction queues at most one target
+    Work work = { malloc((0x10000 + 8) * sizeof(uint16_t)), 0 };
+    cfg->rom_end = rom_end > 0x10000 ? 0x10000 : rom_end;
+
+    for (uint32_t v = 0; v < 0x40; v += 8)
+        Reach(cfg, &work, v, BLOCK_ENTRY);
+    while (work.top > 0)
+    {
+        uint16_t adr = work.stack[--work.top];
+        Trace(cfg, &work, memory, adr);
+    }
+    free(work.stack);
+
+    //blocks run from a leader to a control transfer, the next leader or
+    //the end of the decoded run
+    cfg->blocks = malloc(sizeof(CfgBlock) * 0x10000);
+    for (uint32_t pc = 0; pc < cfg->rom_end; )
+    {
+        if (cfg->map[pc] != CFG_OPCODE)
+        {
+            pc++;
+            continue;
+        }
+        CfgBlock *b = &cfg->blocks[cfg->nblocks++];
+        cfg->marks[pc] |= BLOCK_LEADER;
+        b->start = pc;
+        uint32_t last = pc;
+        for (;;)
+        {
+            uint32_t next = last + lengths8080[memory[last]];
+            if (Flow(memory[last]) != FLOW_NEXT || next >= cfg->rom_end ||
+                cfg->map[next] != CFG_OPCODE || (cfg->marks[next] & BLOCK_LEADER))
+                break;
+            last = next;
+        }
+        b->end = last + lengths8080[memory[last]] - 1;
+        Successors(cfg, b, memory, last);
+        pc = b->end + 1;
+    }
+    cfg->blocks = realloc(cfg->blocks, sizeof(CfgBlock) * (cfg->nblocks ? cfg->nblocks : 1));
+    return cfg;
+}
+
+void CfgFree(Cfg8080 *cfg)
+{
+    if (cfg == NULL)
+        return;
+    free(cfg->blocks);
+    free(cfg);
+}
+
+//index of the block starting at start, or -1
+int CfgFindBlock(const Cfg8080 *cfg, uint16_t start)
+{
+    int lo = 0, hi = cfg->nblocks - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cfg->blocks[mid].start == start)
+            return mid;
+        if (cfg->blocks[mid].start < start)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return -1;
+}
+
+//the name CfgWriteSymbols gives adr, or NULL if it gets none
+static const char* Symbol(const Cfg8080 *cfg, uint16_t adr, char *buf, size_t size)
+{
+    uint8_t m = cfg->marks[adr];
+    if (adr == 0 && (m & BLOCK_ENTRY))
+        snprintf(buf, size, "reset");
+    else if (m & BLOCK_ENTRY)
+        snprintf(buf, size, "rst%d", adr >> 3);
+    else if (m & BLOCK_CALLED)
+        snprintf(buf, size, "%s_%04x", (m & BLOCK_OUTSIDE) ? "ram_sub" : "sub", adr);
+    else if (m & BLOCK_JUMPED)
+        snprintf(buf, size, "%s_%04x", (m & BLOCK_OUTSIDE) ? "ram_loc" : "loc", adr);
+    else
+        return NULL;
+    return buf;
+}
+
+int CfgWriteMap(const Cfg8080 *cfg, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "# start end kind, in hex; code runs are whole instructions\n");
+    uint32_t start = 0;
+    for (uint32_t adr = 1; adr <= cfg->rom_end; adr++)
+    {
+        int code = cfg->map[start] != CFG_DATA;
+        if (adr == cfg->rom_end || (cfg->map[adr] != CFG_DATA) != code)
+        {
+            fprintf(fp, "%04x %04x %s\n", start, adr - 1, code ? "code" : "data");
+            start = adr;
+        }
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int CfgWriteSymbols(const Cfg8080 *cfg, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    for (uint32_t adr = 0; adr < 0x10000; adr++)
+    {
+        char name[32];
+        if (Symbol(cfg, adr, name, sizeof(name)))
+            fprintf(fp, "%04x %s\n", adr, name);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+//one node per block, labelled with its listing; call edges are dashed
+int CfgWriteGraph(const Cfg8080 *cfg, const uint8_t *memory, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "digraph cfg {\n    node [shape=box fontname=monospace];\n");
+    for (int i = 0; i < cfg->nblocks; i++)
+    {
+        const CfgBlock *b = &cfg->blocks[i];
+        char name[32];
+        fprintf(fp, "    b%04x [label=\"", b->start);
+        if (Symbol(cfg, b->start, name, sizeof(name)))
+            fprintf(fp, "%s:\\l", name);
+        for (uint32_t pc = b->start; pc <= b->end; pc += lengths8080[memory[pc]])
+        {
+            char text[32];
+            Disassemble8080(&memory[pc], b->end + 1 - pc, text, sizeof(text));
+            fprintf(fp, "%04x  %s\\l", pc, text);
+        }
+        fprintf(fp, "\"];\n");
+        for (int s = 0; s < b->nsucc; s++)
+            fprintf(fp, "    b%04x -> b%04x;\n", b->start, b->succ[s]);
+        if (b->call >= 0 && CfgFindBlock(cfg, b->call) >= 0)
+            fprintf(fp, "    b%04x -> b%04x [style=dashed];\n", b->start, b->call);
+    }
+    fprintf(fp, "}\n");
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+/* A routine is every block reachable from its entry along successor
+   edges; its callees are the calls those blocks end in. Blocks shared
+   between routines (common tails) count for each. */
+int CfgWriteCalls(const Cfg8080 *cfg, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    int *seen = calloc(cfg->nblocks ? cfg->nblocks : 1, sizeof(int));
+    int *stack = malloc(sizeof(int) * (cfg->nblocks ? cfg->nblocks : 1));
+    uint8_t *callees = calloc(0x10000, 1);
+    int routine = 0;
+
+    fprintf(fp, "digraph calls {\n    node [fontname=monospace];\n");
+    for (uint32_t entry = 0; entry < 0x10000; entry++)
+    {
+        char from[32];
+        if (!(cfg->marks[entry] & (BLOCK_ENTRY | BLOCK_CALLED)) ||
+            !Symbol(cfg, entry, from, sizeof(from)))
+            continue;
+        fprintf(fp, "    \"%s\";\n", from);
+        int first = CfgFindBlock(cfg, entry);
+        if (first < 0)
+            continue;
+
+        routine++;
+        int top = 0;
+        stack[top++] = first;
+        seen[first] = routine;
+        while (top > 0)
+        {
+            const CfgBlock *b = &cfg->blocks[stack[--top]];
+            if (b->call >= 0 && !callees[b->call])
+            {
+                char to[32];
+                callees[b->call] = 1;
+                Symbol(cfg, b->call, to, sizeof(to));
+                fprintf(fp, "    \"%s\" -> \"%s\";\n", from, to);
+            }
+            for (int s = 0; s < b->nsucc; s++)
+            {
+                int k = CfgFindBlock(cfg, b->succ[s]);
+                if (k >= 0 && seen[k] != routine)
+                {
+                    seen[k] = routine;
+                    stack[top++] = k;
+                }
+            }
+        }
+        //only the entries marked above need clearing
+        for (int i = 0; i < cfg->nblocks; i++)
+            if (seen[i] == routine && cfg->blocks[i].call >= 0)
+                callees[cfg->blocks[i].call] = 0;
+    }
+    fprintf(fp, "}\n");
+    free(seen);
+    free(stack);
+    free(callees);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int CfgWriteBlocks(const Cfg8080 *cfg, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "# 8080 block map: start end (last byte), in hex\n");
+    for (int i = 0; i < cfg->nblocks; i++)
+        fprintf(fp, "%04x %04x\n", cfg->blocks[i].start, cfg->blocks[i].end);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+int CfgLoadBlocks(const char *path, uint16_t *starts, int max)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    char line[256];
+    int n = 0;
+    while (n < max && fgets(line, sizeof(line), fp))
+    {
+        unsigned start, end;
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%x %x", &start, &end) == 2 && start <= 0xffff)
+            starts[n++] = start;
+    }
+    fclose(fp);
+    return n;
+}
@@ -0,0 +1,61 @@
+#ifndef CFG
+#define CFG
+
+#include <stdint.h>
+
+/* Static analysis of a ROM image by recursive traversal: decoding
+   starts at reset and the RST vectors and follows jump, call and
+   conditional targets, so bytes nothing reaches stay data. Code is split
+   into basic blocks at every target and after every jump, call and
+   return; the blocks' successors form the control-flow graph, and the
+   blocks reachable from each call target without calling make up that
+   routine for the call graph. Only bytes below rom_end are decoded;
+   targets above it (code copied to RAM) are noted but not followed. One
+   analysis touches nothing but its own Cfg8080, so images can be
+   analysed on as many threads as there are images. */
+
+#define CFG_DATA        0       //per byte in map: nothing reached it
+#define CFG_OPCODE      1
+#define CFG_OPERAND     2
+
+#define BLOCK_LEADER    0x01    //per byte in marks: a block starts here
+#define BLOCK_ENTRY     0x02    //reset or an RST vector
+#define BLOCK_CALLED    0x04    //target of a CALL or RST
+#define BLOCK_JUMPED    0x08    //target of a jump
+#define BLOCK_OUTSIDE   0x10    //a target at or above rom_end
+
+typedef struct CfgBlock{
+    uint16_t    start;
+    uint16_t    end;        //last byte of the last instruction
+    uint16_t    succ[2];    //blocks control can pass to, calls aside
+    uint8_t     nsucc;
+    int32_t     call;       //target of the CALL or RST that ends it, or -1
+}CfgBlock;
+
+typedef struct Cfg8080{
+    uint32_t    rom_end;
+    uint8_t     map[0x10000];   //CFG_*
+    uint8_t     marks[0x10000]; //BLOCK_*
+    CfgBlock    *blocks;        //by start address
+    int         nblocks;
+    int         overlaps;       //targets inside an instruction already decoded
+}Cfg8080;
+
+Cfg8080* CfgAnalyse(const uint8_t *memory, uint32_t rom_end);
+void CfgFree(Cfg8080 *cfg);
+int CfgFindBlock(const Cfg8080 *cfg, uint16_t start);
+
+/* Output: the code/data map as address ranges, a symbol file of
+   "addr name" lines, the CFG and the call graph in Graphviz dot, and
+   the block map, "start end" per line, that CfgLoadBlocks reads back.
+   Each returns 0, or -1 if the file couldn't be written. */
+int CfgWriteMap(const Cfg8080 *cfg, const char *path);
+int CfgWriteSymbols(const Cfg8080 *cfg, const char *path);
+int CfgWriteGraph(const Cfg8080 *cfg, const uint8_t *memory, const char *path);
+int CfgWriteCalls(const Cfg8080 *cfg, const char *path);
+int CfgWriteBlocks(const Cfg8080 *cfg, const char *path);
+
+//fills starts with up to max block starts; returns how many, or -1
+int CfgLoadBlocks(const char *path, uint16_t *starts, int max);
+
+#endif
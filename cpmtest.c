@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "emulator.h"
+#include "trace.h"
+#include "jit.h"
+
+/* Runs CP/M .COM programs, meant for the 8080PRE, TST8080, CPUTEST and
+   8080EXM CPU diagnostics, on just enough of CP/M for them: the program
+   loads at 0x100, CALL 5 goes to a BDOS that does console output
+   (functions 2 and 9) through an OUT to BDOS_PORT, and a jump to 0 (warm
+   boot) halts and ends the run. A console line containing ERROR or FAIL
+   counts as a failed test. Each file can be run on any core.
+   Usage: cpmtest [-c switch|threaded|predecode|jit] [-t] file.com... */
+
+#define BDOS        0xfe00      //the BDOS stub; the word at 6 points here
+#define BDOS_PORT   0xff
+#define SLICE       1000000
+
+enum { CORE_SWITCH, CORE_THREADED, CORE_PREDECODE, CORE_JIT, CORES };
+static const char *core_names[CORES] = { "switch", "threaded", "predecode", "jit" };
+
+typedef struct Console{
+    State8080   *state;
+    char        line[256];      //output since the last newline
+    int         len;
+    int         failed;         //a line reported an error
+}Console;
+
+static void ConsoleLine(Console *con)
+{
+    char upper[sizeof(con->line) + 1];
+    for (int i = 0; i < con->len; i++)
+        upper[i] = toupper((unsigned char) con->line[i]);
+    upper[con->len] = 0;
+    if (strstr(upper, "ERROR") || strstr(upper, "FAIL"))
+    {
+        con->failed = 1;
+        if (con->state->trace)
+            TraceDump(con->state->trace);
+    }
+    con->len = 0;
+}
+
+static void ConsolePut(Console *con, char c)
+{
+    putchar(c);
+    if (c == '\n' || con->len == sizeof(con->line) - 1)
+        ConsoleLine(con);
+    else if (c != '\r' && c != 0)
+        con->line[con->len++] = c;
+}
+
+//the BDOS call: function in C, argument in E or DE
+static void BdosOut(void *ctx, uint8_t port, uint8_t value)
+{
+    Console *con = ctx;
+    State8080 *state = con->state;
+    (void) port;
+    (void) value;
+
+    switch (state->c)
+    {
+        case 2:     //console output
+            ConsolePut(con, state->e);
+            break;
+        case 9:     //print string up to '$'
+        {
+            uint16_t adr = (state->d << 8) | state->e;
+            for (int n = 0; n < 0x10000 && state->memory[adr] != '$'; n++, adr++)
+                ConsolePut(con, state->memory[adr]);
+            break;
+        }
+    }
+    fflush(stdout);
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* The cores are called directly rather than through Run8080: there are
+   no interrupts, and each one returns right after the warm boot HLT, so
+   the cycle count stays exact. */
+static void RunCore(int core, State8080* state)
+{
+    switch (core)
+    {
+        case CORE_SWITCH:       Run8080Switch(state, SLICE); break;
+#if USE_COMPUTED_GOTO
+        case CORE_THREADED:     Run8080Threaded(state, SLICE); break;
+        case CORE_PREDECODE:    Run8080Predecoded(state, SLICE); break;
+#endif
+        case CORE_JIT:          JitRun(state, SLICE); break;
+    }
+    state->stop = 0;
+}
+
+//runs one program to warm boot; returns 0 if it ended without errors
+static int RunProgram(const char *path, int core, int trace)
+{
+    Console con;
+    State8080* state = Initialize8080();
+
+    memset(&con, 0, sizeof(con));
+    con.state = state;
+    if (trace)
+        state->trace = TraceCreate(4096);
+#if USE_COMPUTED_GOTO
+    if (core == CORE_PREDECODE)
+        state->decoded = PredecodeCreate();
+#endif
+    if (core == CORE_JIT && (state->jit = JitCreate()) == NULL)
+    {
+        printf("warning: no JIT on this host, interpreting\n");
+        core = USE_COMPUTED_GOTO ? CORE_THREADED : CORE_SWITCH;
+    }
+
+    state->memory[0x0000] = 0x76;               //HLT
+    state->memory[0x0005] = 0xc3;               //JMP BDOS
+    state->memory[0x0006] = BDOS & 0xff;
+    state->memory[0x0007] = BDOS >> 8;
+    state->memory[BDOS] = 0xd3;                 //OUT BDOS_PORT
+    state->memory[BDOS + 1] = BDOS_PORT;
+    state->memory[BDOS + 2] = 0xc9;             //RET
+    ReadFile(state, (char*) path, 0x100);
+    PortMapOut(state, BDOS_PORT, BdosOut, &con);
+
+    //a RET from the program warm boots too
+    state->sp = BDOS - 2;
+    state->pc = 0x100;
+
+    printf("%s (%s core)\n", path, core_names[core]);
+    double t = Now();
+    while (!state->halted)
+        RunCore(core, state);
+    t = Now() - t;
+    if (con.len)
+        ConsoleLine(&con);
+
+    int ok = !con.failed;
+    if (state->pc != 0x0001)
+    {
+        printf("\nerror: halted at $%04x instead of warm booting\n", state->pc - 1);
+        ok = 0;
+    }
+    printf("\n%s: %s, %llu instructions, %llu cycles, %.2fs (%.1f MIPS)\n", path,
+           ok ? "passed" : "FAILED", (unsigned long long) state->instructions,
+           (unsigned long long) state->cycles, t, state->instructions / t / 1e6);
+    Free8080(state);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char**argv)
+{
+    int core = CORE_THREADED;
+    int trace = 0;
+    int failed = 0;
+    int files = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            i++;
+            for (core = 0; core < CORES; core++)
+                if (strcmp(argv[i], core_names[core]) == 0)
+                    break;
+            if (core == CORES)
+            {
+                printf("error: unknown core %s\n", argv[i]);
+                return 2;
+            }
+#if !USE_COMPUTED_GOTO
+            if (core == CORE_THREADED || core == CORE_PREDECODE)
+            {
+                printf("warning: %s core not built, using switch\n", argv[i]);
+                core = CORE_SWITCH;
+            }
+#endif
+        }
+        //-t dumps the last instructions when a test reports an error
+        else if (strcmp(argv[i], "-t") == 0)
+            trace = 1;
+        else
+        {
+            failed += RunProgram(argv[i], core, trace);
+            files++;
+        }
+    }
+    if (files == 0)
+    {
+        printf("usage: cpmtest [-c switch|threaded|predecode|jit] [-t] file.com...\n");
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
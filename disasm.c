@@ -1,287 +1,408 @@
-#include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "disasm.h"
 
+static const char *mnemonics[MNEMONICS] = {
+    "ACI", "ADC", "ADD", "ADI", "ANA", "ANI", "CALL", "CC", "CM", "CMA",
+    "CMC", "CMP", "CNC", "CNZ", "CP", "CPE", "CPI", "CPO", "CZ", "DAA",
+    "DAD", "DCR", "DCX", "DI", "EI", "HLT", "IN", "INR", "INX", "JC", "JM",
+    "JMP", "JNC", "JNZ", "JP", "JPE", "JPO", "JZ", "LDA", "LDAX", "LHLD",
+    "LXI", "MOV", "MVI", "NOP", "ORA", "ORI", "OUT", "PCHL", "POP", "PUSH",
+    "RAL", "RAR", "RC", "RET", "RLC", "RM", "RNC", "RNZ", "RP", "RPE",
+    "RPO", "RRC", "RST", "RZ", "SBB", "SBI", "SHLD", "SPHL", "STA", "STAX",
+    "STC", "SUB", "SUI", "XCHG", "XRA", "XRI", "XTHL"
+};
 
-int Disassembler(unsigned char *codebuffer, int pc)
-{
-	unsigned char *code = &codebuffer[pc];
-	int opbytes = 1;
-	printf("%04x\t", pc);
+typedef struct OpInfo{
+    uint8_t     mnemonic;
+    const char  *regs;
+    uint8_t     operand;
+}OpInfo;
+
+//by opcode, sixteen to a group
+static const OpInfo ops[256] = {
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_LXI,   "B",     OPERAND_IMM16 },
+    { MNEM_STAX,  "B",     OPERAND_NONE },
+    { MNEM_INX,   "B",     OPERAND_NONE },
+    { MNEM_INR,   "B",     OPERAND_NONE },
+    { MNEM_DCR,   "B",     OPERAND_NONE },
+    { MNEM_MVI,   "B",     OPERAND_IMM8 },
+    { MNEM_RLC,   "",      OPERAND_NONE },
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_DAD,   "B",     OPERAND_NONE },
+    { MNEM_LDAX,  "B",     OPERAND_NONE },
+    { MNEM_DCX,   "B",     OPERAND_NONE },
+    { MNEM_INR,   "C",     OPERAND_NONE },
+    { MNEM_DCR,   "C",     OPERAND_NONE },
+    { MNEM_MVI,   "C",     OPERAND_IMM8 },
+    { MNEM_RRC,   "",      OPERAND_NONE },
+
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_LXI,   "D",     OPERAND_IMM16 },
+    { MNEM_STAX,  "D",     OPERAND_NONE },
+    { MNEM_INX,   "D",     OPERAND_NONE },
+    { MNEM_INR,   "D",     OPERAND_NONE },
+    { MNEM_DCR,   "D",     OPERAND_NONE },
+    { MNEM_MVI,   "D",     OPERAND_IMM8 },
+    { MNEM_RAL,   "",      OPERAND_NONE },
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_DAD,   "D",     OPERAND_NONE },
+    { MNEM_LDAX,  "D",     OPERAND_NONE },
+    { MNEM_DCX,   "D",     OPERAND_NONE },
+    { MNEM_INR,   "E",     OPERAND_NONE },
+    { MNEM_DCR,   "E",     OPERAND_NONE },
+    { MNEM_MVI,   "E",     OPERAND_IMM8 },
+    { MNEM_RAR,   "",      OPERAND_NONE },
+
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_LXI,   "H",     OPERAND_IMM16 },
+    { MNEM_SHLD,  "",      OPERAND_ADDR },
+    { MNEM_INX,   "H",     OPERAND_NONE },
+    { MNEM_INR,   "H",     OPERAND_NONE },
+    { MNEM_DCR,   "H",     OPERAND_NONE },
+    { MNEM_MVI,   "H",     OPERAND_IMM8 },
+    { MNEM_DAA,   "",      OPERAND_NONE },
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_DAD,   "H",     OPERAND_NONE },
+    { MNEM_LHLD,  "",      OPERAND_ADDR },
+    { MNEM_DCX,   "H",     OPERAND_NONE },
+    { MNEM_INR,   "L",     OPERAND_NONE },
+    { MNEM_DCR,   "L",     OPERAND_NONE },
+    { MNEM_MVI,   "L",     OPERAND_IMM8 },
+    { MNEM_CMA,   "",      OPERAND_NONE },
+
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_LXI,   "SP",    OPERAND_IMM16 },
+    { MNEM_STA,   "",      OPERAND_ADDR },
+    { MNEM_INX,   "SP",    OPERAND_NONE },
+    { MNEM_INR,   "M",     OPERAND_NONE },
+    { MNEM_DCR,   "M",     OPERAND_NONE },
+    { MNEM_MVI,   "M",     OPERAND_IMM8 },
+    { MNEM_STC,   "",      OPERAND_NONE },
+    { MNEM_NOP,   "",      OPERAND_NONE },
+    { MNEM_DAD,   "SP",    OPERAND_NONE },
+    { MNEM_LDA,   "",      OPERAND_ADDR },
+    { MNEM_DCX,   "SP",    OPERAND_NONE },
+    { MNEM_INR,   "A",     OPERAND_NONE },
+    { MNEM_DCR,   "A",     OPERAND_NONE },
+    { MNEM_MVI,   "A",     OPERAND_IMM8 },
+    { MNEM_CMC,   "",      OPERAND_NONE },
+
+    { MNEM_MOV,   "B,B",   OPERAND_NONE },
+    { MNEM_MOV,   "B,C",   OPERAND_NONE },
+    { MNEM_MOV,   "B,D",   OPERAND_NONE },
+    { MNEM_MOV,   "B,E",   OPERAND_NONE },
+    { MNEM_MOV,   "B,H",   OPERAND_NONE },
+    { MNEM_MOV,   "B,L",   OPERAND_NONE },
+    { MNEM_MOV,   "B,M",   OPERAND_NONE },
+    { MNEM_MOV,   "B,A",   OPERAND_NONE },
+    { MNEM_MOV,   "C,B",   OPERAND_NONE },
+    { MNEM_MOV,   "C,C",   OPERAND_NONE },
+    { MNEM_MOV,   "C,D",   OPERAND_NONE },
+    { MNEM_MOV,   "C,E",   OPERAND_NONE },
+    { MNEM_MOV,   "C,H",   OPERAND_NONE },
+    { MNEM_MOV,   "C,L",   OPERAND_NONE },
+    { MNEM_MOV,   "C,M",   OPERAND_NONE },
+    { MNEM_MOV,   "C,A",   OPERAND_NONE },
+
+    { MNEM_MOV,   "D,B",   OPERAND_NONE },
+    { MNEM_MOV,   "D,C",   OPERAND_NONE },
+    { MNEM_MOV,   "D,D",   OPERAND_NONE },
+    { MNEM_MOV,   "D,E",   OPERAND_NONE },
+    { MNEM_MOV,   "D,H",   OPERAND_NONE },
+    { MNEM_MOV,   "D,L",   OPERAND_NONE },
+    { MNEM_MOV,   "D,M",   OPERAND_NONE },
+    { MNEM_MOV,   "D,A",   OPERAND_NONE },
+    { MNEM_MOV,   "E,B",   OPERAND_NONE },
+    { MNEM_MOV,   "E,C",   OPERAND_NONE },
+    { MNEM_MOV,   "E,D",   OPERAND_NONE },
+    { MNEM_MOV,   "E,E",   OPERAND_NONE },
+    { MNEM_MOV,   "E,H",   OPERAND_NONE },
+    { MNEM_MOV,   "E,L",   OPERAND_NONE },
+    { MNEM_MOV,   "E,M",   OPERAND_NONE },
+    { MNEM_MOV,   "E,A",   OPERAND_NONE },
+
+    { MNEM_MOV,   "H,B",   OPERAND_NONE },
+    { MNEM_MOV,   "H,C",   OPERAND_NONE },
+    { MNEM_MOV,   "H,D",   OPERAND_NONE },
+    { MNEM_MOV,   "H,E",   OPERAND_NONE },
+    { MNEM_MOV,   "H,H",   OPERAND_NONE },
+    { MNEM_MOV,   "H,L",   OPERAND_NONE },
+    { MNEM_MOV,   "H,M",   OPERAND_NONE },
+    { MNEM_MOV,   "H,A",   OPERAND_NONE },
+    { MNEM_MOV,   "L,B",   OPERAND_NONE },
+    { MNEM_MOV,   "L,C",   OPERAND_NONE },
+    { MNEM_MOV,   "L,D",   OPERAND_NONE },
+    { MNEM_MOV,   "L,E",   OPERAND_NONE },
+    { MNEM_MOV,   "L,H",   OPERAND_NONE },
+    { MNEM_MOV,   "L,L",   OPERAND_NONE },
+    { MNEM_MOV,   "L,M",   OPERAND_NONE },
+    { MNEM_MOV,   "L,A",   OPERAND_NONE },
+
+    { MNEM_MOV,   "M,B",   OPERAND_NONE },
+    { MNEM_MOV,   "M,C",   OPERAND_NONE },
+    { MNEM_MOV,   "M,D",   OPERAND_NONE },
+    { MNEM_MOV,   "M,E",   OPERAND_NONE },
+    { MNEM_MOV,   "M,H",   OPERAND_NONE },
+    { MNEM_MOV,   "M,L",   OPERAND_NONE },
+    { MNEM_HLT,   "",      OPERAND_NONE },
+    { MNEM_MOV,   "M,A",   OPERAND_NONE },
+    { MNEM_MOV,   "A,B",   OPERAND_NONE },
+    { MNEM_MOV,   "A,C",   OPERAND_NONE },
+    { MNEM_MOV,   "A,D",   OPERAND_NONE },
+    { MNEM_MOV,   "A,E",   OPERAND_NONE },
+    { MNEM_MOV,   "A,H",   OPERAND_NONE },
+    { MNEM_MOV,   "A,L",   OPERAND_NONE },
+    { MNEM_MOV,   "A,M",   OPERAND_NONE },
+    { MNEM_MOV,   "A,A",   OPERAND_NONE },
+
+    { MNEM_ADD,   "B",     OPERAND_NONE },
+    { MNEM_ADD,   "C",     OPERAND_NONE },
+    { MNEM_ADD,   "D",     OPERAND_NONE },
+    { MNEM_ADD,   "E",     OPERAND_NONE },
+    { MNEM_ADD,   "H",     OPERAND_NONE },
+    { MNEM_ADD,   "L",     OPERAND_NONE },
+    { MNEM_ADD,   "M",     OPERAND_NONE },
+    { MNEM_ADD,   "A",     OPERAND_NONE },
+    { MNEM_ADC,   "B",     OPERAND_NONE },
+    { MNEM_ADC,   "C",     OPERAND_NONE },
+    { MNEM_ADC,   "D",     OPERAND_NONE },
+    { MNEM_ADC,   "E",     OPERAND_NONE },
+    { MNEM_ADC,   "H",     OPERAND_NONE },
+    { MNEM_ADC,   "L",     OPERAND_NONE },
+    { MNEM_ADC,   "M",     OPERAND_NONE },
+    { MNEM_ADC,   "A",     OPERAND_NONE },
+
+    { MNEM_SUB,   "B",     OPERAND_NONE },
+    { MNEM_SUB,   "C",     OPERAND_NONE },
+    { MNEM_SUB,   "D",     OPERAND_NONE },
+    { MNEM_SUB,   "E",     OPERAND_NONE },
+    { MNEM_SUB,   "H",     OPERAND_NONE },
+    { MNEM_SUB,   "L",     OPERAND_NONE },
+    { MNEM_SUB,   "M",     OPERAND_NONE },
+    { MNEM_SUB,   "A",     OPERAND_NONE },
+    { MNEM_SBB,   "B",     OPERAND_NONE },
+    { MNEM_SBB,   "C",     OPERAND_NONE },
+    { MNEM_SBB,   "D",     OPERAND_NONE },
+    { MNEM_SBB,   "E",     OPERAND_NONE },
+    { MNEM_SBB,   "H",     OPERAND_NONE },
+    { MNEM_SBB,   "L",     OPERAND_NONE },
+    { MNEM_SBB,   "M",     OPERAND_NONE },
+    { MNEM_SBB,   "A",     OPERAND_NONE },
+
+    { MNEM_ANA,   "B",     OPERAND_NONE },
+    { MNEM_ANA,   "C",     OPERAND_NONE },
+    { MNEM_ANA,   "D",     OPERAND_NONE },
+    { MNEM_ANA,   "E",     OPERAND_NONE },
+    { MNEM_ANA,   "H",     OPERAND_NONE },
+    { MNEM_ANA,   "L",     OPERAND_NONE },
+    { MNEM_ANA,   "M",     OPERAND_NONE },
+    { MNEM_ANA,   "A",     OPERAND_NONE },
+    { MNEM_XRA,   "B",     OPERAND_NONE },
+    { MNEM_XRA,   "C",     OPERAND_NONE },
+    { MNEM_XRA,   "D",     OPERAND_NONE },
+    { MNEM_XRA,   "E",     OPERAND_NONE },
+    { MNEM_XRA,   "H",     OPERAND_NONE },
+    { MNEM_XRA,   "L",     OPERAND_NONE },
+    { MNEM_XRA,   "M",     OPERAND_NONE },
+    { MNEM_XRA,   "A",     OPERAND_NONE },
 
-	switch (*code)
-	{
-		case 0x00: printf("NOP"); break;
-		case 0x01: printf("LXI    B,#$%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x02: printf("STAX   B"); break;
-		case 0x03: printf("INX    B"); break;
-		case 0x04: printf("INR    B"); break;
-		case 0x05: printf("DCR    B"); break;
-		case 0x06: printf("MVI    B,#$%02x", code[1]); opbytes=2; break;
-		case 0x07: printf("RLC"); break;
-		case 0x08: printf("NOP"); break;
-		case 0x09: printf("DAD    B"); break;
-		case 0x0a: printf("LDAX   B"); break;
-		case 0x0b: printf("DCX    B"); break;
-		case 0x0c: printf("INR    C"); break;
-		case 0x0d: printf("DCR    C"); break;
-		case 0x0e: printf("MVI    C,#$%02x", code[1]); opbytes = 2;	break;
-		case 0x0f: printf("RRC"); break;
-			
-		case 0x10: printf("NOP"); break;
-		case 0x11: printf("LXI    D,#$%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x12: printf("STAX   D"); break;
-		case 0x13: printf("INX    D"); break;
-		case 0x14: printf("INR    D"); break;
-		case 0x15: printf("DCR    D"); break;
-		case 0x16: printf("MVI    D,#$%02x", code[1]); opbytes=2; break;
-		case 0x17: printf("RAL"); break;
-		case 0x18: printf("NOP"); break;
-		case 0x19: printf("DAD    D"); break;
-		case 0x1a: printf("LDAX   D"); break;
-		case 0x1b: printf("DCX    D"); break;
-		case 0x1c: printf("INR    E"); break;
-		case 0x1d: printf("DCR    E"); break;
-		case 0x1e: printf("MVI    E,#$%02x", code[1]); opbytes = 2; break;
-		case 0x1f: printf("RAR"); break;
-			
-		case 0x20: printf("NOP"); break;
-		case 0x21: printf("LXI    H,#$%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x22: printf("SHLD   $%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x23: printf("INX    H"); break;
-		case 0x24: printf("INR    H"); break;
-		case 0x25: printf("DCR    H"); break;
-		case 0x26: printf("MVI    H,#$%02x", code[1]); opbytes=2; break;
-		case 0x27: printf("DAA"); break;
-		case 0x28: printf("NOP"); break;
-		case 0x29: printf("DAD    H"); break;
-		case 0x2a: printf("LHLD   $%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x2b: printf("DCX    H"); break;
-		case 0x2c: printf("INR    L"); break;
-		case 0x2d: printf("DCR    L"); break;
-		case 0x2e: printf("MVI    L,#$%02x", code[1]); opbytes = 2; break;
-		case 0x2f: printf("CMA"); break;
-			
-		case 0x30: printf("NOP"); break;
-		case 0x31: printf("LXI    SP,#$%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x32: printf("STA    $%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x33: printf("INX    SP"); break;
-		case 0x34: printf("INR    M"); break;
-		case 0x35: printf("DCR    M"); break;
-		case 0x36: printf("MVI    M,#$%02x", code[1]); opbytes=2; break;
-		case 0x37: printf("STC"); break;
-		case 0x38: printf("NOP"); break;
-		case 0x39: printf("DAD    SP"); break;
-		case 0x3a: printf("LDA    $%02x%02x", code[2], code[1]); opbytes=3; break;
-		case 0x3b: printf("DCX    SP"); break;
-		case 0x3c: printf("INR    A"); break;
-		case 0x3d: printf("DCR    A"); break;
-		case 0x3e: printf("MVI    A,#$%02x", code[1]); opbytes = 2; break;
-		case 0x3f: printf("CMC"); break;
-			
-		case 0x40: printf("MOV    B,B"); break;
-		case 0x41: printf("MOV    B,C"); break;
-		case 0x42: printf("MOV    B,D"); break;
-		case 0x43: printf("MOV    B,E"); break;
-		case 0x44: printf("MOV    B,H"); break;
-		case 0x45: printf("MOV    B,L"); break;
-		case 0x46: printf("MOV    B,M"); break;
-		case 0x47: printf("MOV    B,A"); break;
-		case 0x48: printf("MOV    C,B"); break;
-		case 0x49: printf("MOV    C,C"); break;
-		case 0x4a: printf("MOV    C,D"); break;
-		case 0x4b: printf("MOV    C,E"); break;
-		case 0x4c: printf("MOV    C,H"); break;
-		case 0x4d: printf("MOV    C,L"); break;
-		case 0x4e: printf("MOV    C,M"); break;
-		case 0x4f: printf("MOV    C,A"); break;
-			
-		case 0x50: printf("MOV    D,B"); break;
-		case 0x51: printf("MOV    D,C"); break;
-		case 0x52: printf("MOV    D,D"); break;
-		case 0x53: printf("MOV    D.E"); break;
-		case 0x54: printf("MOV    D,H"); break;
-		case 0x55: printf("MOV    D,L"); break;
-		case 0x56: printf("MOV    D,M"); break;
-		case 0x57: printf("MOV    D,A"); break;
-		case 0x58: printf("MOV    E,B"); break;
-		case 0x59: printf("MOV    E,C"); break;
-		case 0x5a: printf("MOV    E,D"); break;
-		case 0x5b: printf("MOV    E,E"); break;
-		case 0x5c: printf("MOV    E,H"); break;
-		case 0x5d: printf("MOV    E,L"); break;
-		case 0x5e: printf("MOV    E,M"); break;
-		case 0x5f: printf("MOV    E,A"); break;
+    { MNEM_ORA,   "B",     OPERAND_NONE },
+    { MNEM_ORA,   "C",     OPERAND_NONE },
+    { MNEM_ORA,   "D",     OPERAND_NONE },
+    { MNEM_ORA,   "E",     OPERAND_NONE },
+    { MNEM_ORA,   "H",     OPERAND_NONE },
+    { MNEM_ORA,   "L",     OPERAND_NONE },
+    { MNEM_ORA,   "M",     OPERAND_NONE },
+    { MNEM_ORA,   "A",     OPERAND_NONE },
+    { MNEM_CMP,   "B",     OPERAND_NONE },
+    { MNEM_CMP,   "C",     OPERAND_NONE },
+    { MNEM_CMP,   "D",     OPERAND_NONE },
+    { MNEM_CMP,   "E",     OPERAND_NONE },
+    { MNEM_CMP,   "H",     OPERAND_NONE },
+    { MNEM_CMP,   "L",     OPERAND_NONE },
+    { MNEM_CMP,   "M",     OPERAND_NONE },
+    { MNEM_CMP,   "A",     OPERAND_NONE },
 
-		case 0x60: printf("MOV    H,B"); break;
-		case 0x61: printf("MOV    H,C"); break;
-		case 0x62: printf("MOV    H,D"); break;
-		case 0x63: printf("MOV    H.E"); break;
-		case 0x64: printf("MOV    H,H"); break;
-		case 0x65: printf("MOV    H,L"); break;
-		case 0x66: printf("MOV    H,M"); break;
-		case 0x67: printf("MOV    H,A"); break;
-		case 0x68: printf("MOV    L,B"); break;
-		case 0x69: printf("MOV    L,C"); break;
-		case 0x6a: printf("MOV    L,D"); break;
-		case 0x6b: printf("MOV    L,E"); break;
-		case 0x6c: printf("MOV    L,H"); break;
-		case 0x6d: printf("MOV    L,L"); break;
-		case 0x6e: printf("MOV    L,M"); break;
-		case 0x6f: printf("MOV    L,A"); break;
+    { MNEM_RNZ,   "",      OPERAND_NONE },
+    { MNEM_POP,   "B",     OPERAND_NONE },
+    { MNEM_JNZ,   "",      OPERAND_ADDR },
+    { MNEM_JMP,   "",      OPERAND_ADDR },
+    { MNEM_CNZ,   "",      OPERAND_ADDR },
+    { MNEM_PUSH,  "B",     OPERAND_NONE },
+    { MNEM_ADI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "0",     OPERAND_NONE },
+    { MNEM_RZ,    "",      OPERAND_NONE },
+    { MNEM_RET,   "",      OPERAND_NONE },
+    { MNEM_JZ,    "",      OPERAND_ADDR },
+    { MNEM_JMP,   "",      OPERAND_ADDR },
+    { MNEM_CZ,    "",      OPERAND_ADDR },
+    { MNEM_CALL,  "",      OPERAND_ADDR },
+    { MNEM_ACI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "1",     OPERAND_NONE },
 
-		case 0x70: printf("MOV    M,B"); break;
-		case 0x71: printf("MOV    M,C"); break;
-		case 0x72: printf("MOV    M,D"); break;
-		case 0x73: printf("MOV    M.E"); break;
-		case 0x74: printf("MOV    M,H"); break;
-		case 0x75: printf("MOV    M,L"); break;
-		case 0x76: printf("HLT");        break;
-		case 0x77: printf("MOV    M,A"); break;
-		case 0x78: printf("MOV    A,B"); break;
-		case 0x79: printf("MOV    A,C"); break;
-		case 0x7a: printf("MOV    A,D"); break;
-		case 0x7b: printf("MOV    A,E"); break;
-		case 0x7c: printf("MOV    A,H"); break;
-		case 0x7d: printf("MOV    A,L"); break;
-		case 0x7e: printf("MOV    A,M"); break;
-		case 0x7f: printf("MOV    A,A"); break;
+    { MNEM_RNC,   "",      OPERAND_NONE },
+    { MNEM_POP,   "D",     OPERAND_NONE },
+    { MNEM_JNC,   "",      OPERAND_ADDR },
+    { MNEM_OUT,   "",      OPERAND_PORT },
+    { MNEM_CNC,   "",      OPERAND_ADDR },
+    { MNEM_PUSH,  "D",     OPERAND_NONE },
+    { MNEM_SUI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "2",     OPERAND_NONE },
+    { MNEM_RC,    "",      OPERAND_NONE },
+    { MNEM_RET,   "",      OPERAND_NONE },
+    { MNEM_JC,    "",      OPERAND_ADDR },
+    { MNEM_IN,    "",      OPERAND_PORT },
+    { MNEM_CC,    "",      OPERAND_ADDR },
+    { MNEM_CALL,  "",      OPERAND_ADDR },
+    { MNEM_SBI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "3",     OPERAND_NONE },
 
-		case 0x80: printf("ADD    B"); break;
-		case 0x81: printf("ADD    C"); break;
-		case 0x82: printf("ADD    D"); break;
-		case 0x83: printf("ADD    E"); break;
-		case 0x84: printf("ADD    H"); break;
-		case 0x85: printf("ADD    L"); break;
-		case 0x86: printf("ADD    M"); break;
-		case 0x87: printf("ADD    A"); break;
-		case 0x88: printf("ADC    B"); break;
-		case 0x89: printf("ADC    C"); break;
-		case 0x8a: printf("ADC    D"); break;
-		case 0x8b: printf("ADC    E"); break;
-		case 0x8c: printf("ADC    H"); break;
-		case 0x8d: printf("ADC    L"); break;
-		case 0x8e: printf("ADC    M"); break;
-		case 0x8f: printf("ADC    A"); break;
+    { MNEM_RPO,   "",      OPERAND_NONE },
+    { MNEM_POP,   "H",     OPERAND_NONE },
+    { MNEM_JPO,   "",      OPERAND_ADDR },
+    { MNEM_XTHL,  "",      OPERAND_NONE },
+    { MNEM_CPO,   "",      OPERAND_ADDR },
+    { MNEM_PUSH,  "H",     OPERAND_NONE },
+    { MNEM_ANI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "4",     OPERAND_NONE },
+    { MNEM_RPE,   "",      OPERAND_NONE },
+    { MNEM_PCHL,  "",      OPERAND_NONE },
+    { MNEM_JPE,   "",      OPERAND_ADDR },
+    { MNEM_XCHG,  "",      OPERAND_NONE },
+    { MNEM_CPE,   "",      OPERAND_ADDR },
+    { MNEM_CALL,  "",      OPERAND_ADDR },
+    { MNEM_XRI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "5",     OPERAND_NONE },
 
-		case 0x90: printf("SUB    B"); break;
-		case 0x91: printf("SUB    C"); break;
-		case 0x92: printf("SUB    D"); break;
-		case 0x93: printf("SUB    E"); break;
-		case 0x94: printf("SUB    H"); break;
-		case 0x95: printf("SUB    L"); break;
-		case 0x96: printf("SUB    M"); break;
-		case 0x97: printf("SUB    A"); break;
-		case 0x98: printf("SBB    B"); break;
-		case 0x99: printf("SBB    C"); break;
-		case 0x9a: printf("SBB    D"); break;
-		case 0x9b: printf("SBB    E"); break;
-		case 0x9c: printf("SBB    H"); break;
-		case 0x9d: printf("SBB    L"); break;
-		case 0x9e: printf("SBB    M"); break;
-		case 0x9f: printf("SBB    A"); break;
+    { MNEM_RP,    "",      OPERAND_NONE },
+    { MNEM_POP,   "PSW",   OPERAND_NONE },
+    { MNEM_JP,    "",      OPERAND_ADDR },
+    { MNEM_DI,    "",      OPERAND_NONE },
+    { MNEM_CP,    "",      OPERAND_ADDR },
+    { MNEM_PUSH,  "PSW",   OPERAND_NONE },
+    { MNEM_ORI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "6",     OPERAND_NONE },
+    { MNEM_RM,    "",      OPERAND_NONE },
+    { MNEM_SPHL,  "",      OPERAND_NONE },
+    { MNEM_JM,    "",      OPERAND_ADDR },
+    { MNEM_EI,    "",      OPERAND_NONE },
+    { MNEM_CM,    "",      OPERAND_ADDR },
+    { MNEM_CALL,  "",      OPERAND_ADDR },
+    { MNEM_CPI,   "",      OPERAND_IMM8 },
+    { MNEM_RST,   "7",     OPERAND_NONE },
+};
 
-		case 0xa0: printf("ANA    B"); break;
-		case 0xa1: printf("ANA    C"); break;
-		case 0xa2: printf("ANA    D"); break;
-		case 0xa3: printf("ANA    E"); break;
-		case 0xa4: printf("ANA    H"); break;
-		case 0xa5: printf("ANA    L"); break;
-		case 0xa6: printf("ANA    M"); break;
-		case 0xa7: printf("ANA    A"); break;
-		case 0xa8: printf("XRA    B"); break;
-		case 0xa9: printf("XRA    C"); break;
-		case 0xaa: printf("XRA    D"); break;
-		case 0xab: printf("XRA    E"); break;
-		case 0xac: printf("XRA    H"); break;
-		case 0xad: printf("XRA    L"); break;
-		case 0xae: printf("XRA    M"); break;
-		case 0xaf: printf("XRA    A"); break;
+static const uint8_t operand_bytes[] = { 0, 1, 2, 2, 1 };
 
-		case 0xb0: printf("ORA    B"); break;
-		case 0xb1: printf("ORA    C"); break;
-		case 0xb2: printf("ORA    D"); break;
-		case 0xb3: printf("ORA    E"); break;
-		case 0xb4: printf("ORA    H"); break;
-		case 0xb5: printf("ORA    L"); break;
-		case 0xb6: printf("ORA    M"); break;
-		case 0xb7: printf("ORA    A"); break;
-		case 0xb8: printf("CMP    B"); break;
-		case 0xb9: printf("CMP    C"); break;
-		case 0xba: printf("CMP    D"); break;
-		case 0xbb: printf("CMP    E"); break;
-		case 0xbc: printf("CMP    H"); break;
-		case 0xbd: printf("CMP    L"); break;
-		case 0xbe: printf("CMP    M"); break;
-		case 0xbf: printf("CMP    A"); break;
+const char* MnemonicName(int mnemonic)
+{
+    return (mnemonic >= 0 && mnemonic < MNEMONICS) ? mnemonics[mnemonic] : "???";
+}
+
+/* Fills in ins from the instruction at code, reading no more than avail
+   bytes. Returns the instruction's length, which is more than avail when
+   it was cut off, or 0 when there was nothing to decode. */
+int Decode8080(const uint8_t *code, size_t avail, Instr8080 *ins)
+{
+    if (avail == 0)
+        return 0;
+    const OpInfo *info = &ops[code[0]];
+    int length = 1 + operand_bytes[info->operand];
+    ins->opcode = code[0];
+    ins->mnemonic = info->mnemonic;
+    ins->operand = info->operand;
+    ins->length = length;
+    ins->present = (avail < (size_t) length) ? (uint8_t) avail : length;
+    ins->regs = info->regs;
+    ins->value = 0;
+    if (length > 1 && avail > 1)
+        ins->value = code[1];
+    if (length > 2 && avail > 2)
+        ins->value |= code[2] << 8;
+    return length;
+}
 
-		case 0xc0: printf("RNZ"); break;
-		case 0xc1: printf("POP    B"); break;
-		case 0xc2: printf("JNZ    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xc3: printf("JMP    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xc4: printf("CNZ    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xc5: printf("PUSH   B"); break;
-		case 0xc6: printf("ADI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xc7: printf("RST    0"); break;
-		case 0xc8: printf("RZ"); break;
-		case 0xc9: printf("RET"); break;
-		case 0xca: printf("JZ     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xcb: printf("JMP    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xcc: printf("CZ     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xcd: printf("CALL   $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xce: printf("ACI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xcf: printf("RST    1"); break;
+//appends to a caller's buffer, counting what didn't fit like snprintf
+typedef struct Text{
+    char        *buf;
+    size_t      size;
+    size_t      len;
+}Text;
 
-		case 0xd0: printf("RNC"); break;
-		case 0xd1: printf("POP    D"); break;
-		case 0xd2: printf("JNC    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xd3: printf("OUT    #$%02x",code[1]); opbytes = 2; break;
-		case 0xd4: printf("CNC    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xd5: printf("PUSH   D"); break;
-		case 0xd6: printf("SUI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xd7: printf("RST    2"); break;
-		case 0xd8: printf("RC");  break;
-		case 0xd9: printf("RET"); break;
-		case 0xda: printf("JC     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xdb: printf("IN     #$%02x",code[1]); opbytes = 2; break;
-		case 0xdc: printf("CC     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xdd: printf("CALL   $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xde: printf("SBI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xdf: printf("RST    3"); break;
+static void Put(Text *t, char c)
+{
+    if (t->len + 1 < t->size)
+        t->buf[t->len] = c;
+    t->len++;
+}
 
-		case 0xe0: printf("RPO"); break;
-		case 0xe1: printf("POP    H"); break;
-		case 0xe2: printf("JPO    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xe3: printf("XTHL");break;
-		case 0xe4: printf("CPO    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xe5: printf("PUSH   H"); break;
-		case 0xe6: printf("ANI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xe7: printf("RST    4"); break;
-		case 0xe8: printf("RPE"); break;
-		case 0xe9: printf("PCHL");break;
-		case 0xea: printf("JPE    $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xeb: printf("XCHG"); break;
-		case 0xec: printf("CPE     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xed: printf("CALL   $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xee: printf("XRI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xef: printf("RST    5"); break;
+static void PutString(Text *t, const char *s)
+{
+    while (*s)
+        Put(t, *s++);
+}
+
+static void PutHex(Text *t, unsigned value, int digits, int known)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; i--)
+        Put(t, i < known ? hex[(value >> (i * 4)) & 0xf] : '?');
+}
 
-		case 0xf0: printf("RP");  break;
-		case 0xf1: printf("POP    PSW"); break;
-		case 0xf2: printf("JP     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xf3: printf("DI");  break;
-		case 0xf4: printf("CP     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xf5: printf("PUSH   PSW"); break;
-		case 0xf6: printf("ORI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xf7: printf("RST    6"); break;
-		case 0xf8: printf("RM");  break;
-		case 0xf9: printf("SPHL");break;
-		case 0xfa: printf("JM     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xfb: printf("EI");  break;
-		case 0xfc: printf("CM     $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xfd: printf("CALL   $%02x%02x",code[2],code[1]); opbytes = 3; break;
-		case 0xfe: printf("CPI    #$%02x",code[1]); opbytes = 2; break;
-		case 0xff: printf("RST    7"); break;
-	}
-	return opbytes;
-}
\ No newline at end of file
+/* Writes the listing text of ins ("MVI    B,#$12") to buf, truncating
+   it to fit size. Bytes a cut off instruction lacked show as ??.
+   Returns the length of the whole text, as snprintf does. */
+int Format8080(const Instr8080 *ins, char *buf, size_t size)
+{
+    Text t = { buf, size, 0 };
+    const char *name = MnemonicName(ins->mnemonic);
+    PutString(&t, name);
+    if (ins->regs[0] || ins->operand != OPERAND_NONE)
+    {
+        for (size_t n = strlen(name); n < 7; n++)
+            Put(&t, ' ');
+        PutString(&t, ins->regs);
+    }
+    if (ins->operand != OPERAND_NONE)
+    {
+        int digits = operand_bytes[ins->operand] * 2;
+        int known = (ins->present - 1) * 2;
+        if (ins->regs[0])
+            Put(&t, ',');
+        if (ins->operand != OPERAND_ADDR)
+            Put(&t, '#');
+        Put(&t, '$');
+        PutHex(&t, ins->value, digits, known);
+    }
+    if (size > 0)
+        buf[t.len < size ? t.len : size - 1] = 0;
+    return (int) t.len;
+}
+
+//decodes and formats in one go; returns the instruction length as Decode8080
+int Disassemble8080(const uint8_t *code, size_t avail, char *buf, size_t size)
+{
+    Instr8080 ins;
+    int length = Decode8080(code, avail, &ins);
+    if (length == 0)
+    {
+        if (size > 0)
+            buf[0] = 0;
+        return 0;
+    }
+    Format8080(&ins, buf, size);
+    return length;
+}
+
+/* Prints the instruction at pc in codebuffer, a whole 64K memory image,
+   as "pc<tab>text" on stdout. */
+int Disassembler(unsigned char *codebuffer, int pc)
+{
+    char text[32];
+    int length = Disassemble8080(&codebuffer[pc & 0xffff], 0x10000 - (pc & 0xffff),
+                                 text, sizeof(text));
+    printf("%04x\t%s", pc & 0xffff, text);
+    return length;
+}
@@ -1,6 +1,50 @@
 #ifndef DISASM
 #define DISASM
 
+#include <stddef.h>
+#include <stdint.h>
+
+/* Decoding is a table lookup and formatting writes into the caller's
+   buffer, so neither touches stdio or any shared state and both can run
+   on any number of threads. Neither reads past the bytes it is given. */
+
+enum {
+    MNEM_ACI, MNEM_ADC, MNEM_ADD, MNEM_ADI, MNEM_ANA, MNEM_ANI, MNEM_CALL,
+    MNEM_CC, MNEM_CM, MNEM_CMA, MNEM_CMC, MNEM_CMP, MNEM_CNC, MNEM_CNZ,
+    MNEM_CP, MNEM_CPE, MNEM_CPI, MNEM_CPO, MNEM_CZ, MNEM_DAA, MNEM_DAD,
+    MNEM_DCR, MNEM_DCX, MNEM_DI, MNEM_EI, MNEM_HLT, MNEM_IN, MNEM_INR,
+    MNEM_INX, MNEM_JC, MNEM_JM, MNEM_JMP, MNEM_JNC, MNEM_JNZ, MNEM_JP,
+    MNEM_JPE, MNEM_JPO, MNEM_JZ, MNEM_LDA, MNEM_LDAX, MNEM_LHLD, MNEM_LXI,
+    MNEM_MOV, MNEM_MVI, MNEM_NOP, MNEM_ORA, MNEM_ORI, MNEM_OUT, MNEM_PCHL,
+    MNEM_POP, MNEM_PUSH, MNEM_RAL, MNEM_RAR, MNEM_RC, MNEM_RET, MNEM_RLC,
+    MNEM_RM, MNEM_RNC, MNEM_RNZ, MNEM_RP, MNEM_RPE, MNEM_RPO, MNEM_RRC,
+    MNEM_RST, MNEM_RZ, MNEM_SBB, MNEM_SBI, MNEM_SHLD, MNEM_SPHL, MNEM_STA,
+    MNEM_STAX, MNEM_STC, MNEM_SUB, MNEM_SUI, MNEM_XCHG, MNEM_XRA, MNEM_XRI,
+    MNEM_XTHL, MNEMONICS
+};
+
+enum {
+    OPERAND_NONE,
+    OPERAND_IMM8,       //#$nn
+    OPERAND_IMM16,      //#$nnnn
+    OPERAND_ADDR,       //$nnnn, a jump, call or memory address
+    OPERAND_PORT,       //#$nn, the port of IN and OUT
+};
+
+typedef struct Instr8080{
+    uint8_t     opcode;
+    uint8_t     mnemonic;   //MNEM_*
+    uint8_t     operand;    //OPERAND_*, what the bytes after the opcode hold
+    uint8_t     length;     //1 to 3 bytes
+    uint8_t     present;    //bytes of it the buffer held, less if cut off
+    uint16_t    value;      //the operand; missing bytes read as 0
+    const char  *regs;      //register operands as listed, "" if none
+}Instr8080;
+
+int Decode8080(const uint8_t *code, size_t avail, Instr8080 *ins);
+int Format8080(const Instr8080 *ins, char *buf, size_t size);
+int Disassemble8080(const uint8_t *code, size_t avail, char *buf, size_t size);
+const char* MnemonicName(int mnemonic);
 int Disassembler(unsigned char *codebuffer, int pc);
 
-#endif
\ No newline at end of file
+#endif
@@ -1,696 +1,547 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include "disasm.h"
-
-typedef struct ConditionCodes{
-    uint8_t     z:1;
-    uint8_t     p:1;
-    uint8_t     s:1;
-    uint8_t     cy:1;
-    uint8_t     ac:1;
-    uint8_t     pad:3;
-}ConditionCodes;
-
-typedef struct State8080{
-    uint8_t     a;
-    uint8_t     b;
-    uint8_t     c;
-    uint8_t     d;
-    uint8_t     e;
-    uint8_t     h;
-    uint8_t     l;
-    uint16_t     sp;
-    uint16_t     pc;
-    uint8_t     *memory;
-    struct  ConditionCodes   cc;
-    uint8_t     int_enable;
-}State8080;
-
-int Parity(int x, int size){
-    int p=0;
-    x = (x & ((1<<size)-1));
-    for (int i=0; i < size; i++ ){
-        if (x& 0x1) p++;
-        x = (x>>1); 
+#include <sys/mman.h>
+#include "emulator.h"
+#include "trace.h"
+#include "jit.h"
+#include "replay.h"
+#include "profile.h"
+#include "gdb.h"
+
+/* Clock cycles per opcode. Conditional CALL and RET list the not-taken
+   count; taking the branch costs CONDITIONAL_TAKEN more. */
+const uint8_t cycles8080[256] = {
+    4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4,          //0x00..0x0f
+    4, 10, 7, 5, 5, 5, 7, 4, 4, 10, 7, 5, 5, 5, 7, 4,          //0x10..0x1f
+    4, 10, 16, 5, 5, 5, 7, 4, 4, 10, 16, 5, 5, 5, 7, 4,        //0x20..0x2f
+    4, 10, 13, 5, 10, 10, 10, 4, 4, 10, 13, 5, 5, 5, 7, 4,     //0x30..0x3f
+    5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,            //0x40..0x4f
+    5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,            //0x50..0x5f
+    5, 5, 5, 5, 5, 5, 7, 5, 5, 5, 5, 5, 5, 5, 7, 5,            //0x60..0x6f
+    7, 7, 7, 7, 7, 7, 7, 7, 5, 5, 5, 5, 5, 5, 7, 5,            //0x70..0x7f
+    4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,            //0x80..0x8f
+    4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,            //0x90..0x9f
+    4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,            //0xa0..0xaf
+    4, 4, 4, 4, 4, 4, 7, 4, 4, 4, 4, 4, 4, 4, 7, 4,            //0xb0..0xbf
+    5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11, //0xc0..0xcf
+    5, 10, 10, 10, 11, 11, 7, 11, 5, 10, 10, 10, 11, 17, 7, 11, //0xd0..0xdf
+    5, 10, 10, 18, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11,   //0xe0..0xef
+    5, 10, 10, 4, 11, 11, 7, 11, 5, 5, 10, 4, 11, 17, 7, 11,    //0xf0..0xff
+};
+
+//instruction length in bytes, opcode included
+const uint8_t lengths8080[256] = {
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,            //0x00..0x0f
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1,            //0x10..0x1f
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,            //0x20..0x2f
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1,            //0x30..0x3f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x40..0x4f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x50..0x5f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x60..0x6f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x70..0x7f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x80..0x8f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0x90..0x9f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0xa0..0xaf
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,            //0xb0..0xbf
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1,            //0xc0..0xcf
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1,            //0xd0..0xdf
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,            //0xe0..0xef
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1,            //0xf0..0xff
+};
+
+/* Z, S and P for every 8-bit result, as ZSP_Z | ZSP_S | ZSP_P. */
+const uint8_t zsp8080[256] = {
+    5, 0, 0, 4, 0, 4, 4, 0, 0, 4, 4, 0, 4, 0, 0, 4,
+    0, 4, 4, 0, 4, 0, 0, 4, 4, 0, 0, 4, 0, 4, 4, 0,
+    0, 4, 4, 0, 4, 0, 0, 4, 4, 0, 0, 4, 0, 4, 4, 0,
+    4, 0, 0, 4, 0, 4, 4, 0, 0, 4, 4, 0, 4, 0, 0, 4,
+    0, 4, 4, 0, 4, 0, 0, 4, 4, 0, 0, 4, 0, 4, 4, 0,
+    4, 0, 0, 4, 0, 4, 4, 0, 0, 4, 4, 0, 4, 0, 0, 4,
+    4, 0, 0, 4, 0, 4, 4, 0, 0, 4, 4, 0, 4, 0, 0, 4,
+    0, 4, 4, 0, 4, 0, 0, 4, 4, 0, 0, 4, 0, 4, 4, 0,
+    2, 6, 6, 2, 6, 2, 2, 6, 6, 2, 2, 6, 2, 6, 6, 2,
+    6, 2, 2, 6, 2, 6, 6, 2, 2, 6, 6, 2, 6, 2, 2, 6,
+    6, 2, 2, 6, 2, 6, 6, 2, 2, 6, 6, 2, 6, 2, 2, 6,
+    2, 6, 6, 2, 6, 2, 2, 6, 6, 2, 2, 6, 2, 6, 6, 2,
+    6, 2, 2, 6, 2, 6, 6, 2, 2, 6, 6, 2, 6, 2, 2, 6,
+    2, 6, 6, 2, 6, 2, 2, 6, 6, 2, 2, 6, 2, 6, 6, 2,
+    2, 6, 6, 2, 6, 2, 2, 6, 6, 2, 2, 6, 2, 6, 6, 2,
+    6, 2, 2, 6, 2, 6, 6, 2, 2, 6, 6, 2, 6, 2, 2, 6,
+};
+
+/* Folds the pending ALU op into cc. Called whenever the flags are read
+   as a whole (PUSH PSW, tracing) or only part of them is about to be
+   overwritten. */
+void SyncFlags(State8080 *state)
+{
+    uint16_t res = state->flag_res;
+    uint8_t x = res & 0xff;
+    uint8_t a = state->flag_op1;
+    uint8_t b = state->flag_op2;
+
+    switch (state->flag_kind)
+    {
+        case FLAGS_NONE:
+            return;
+        case FLAGS_ADD:
+            state->cc.cy = (res > 0xff);
+            state->cc.ac = ((a ^ b ^ res) & 0x10) != 0;
+            break;
+        case FLAGS_SUB:
+            //borrow wraps the 16-bit difference; aux carry is the carry
+            //out of bit 3 of a + ~b + 1
+            state->cc.cy = (res > 0xff);
+            state->cc.ac = ((a ^ b ^ res) & 0x10) == 0;
+            break;
+        case FLAGS_LOGIC:
+            state->cc.cy = state->cc.ac = 0;
+            break;
+        case FLAGS_AND:
+            //ANA/ANI set aux carry to bit 3 of either operand
+            state->cc.cy = 0;
+            state->cc.ac = ((a | b) & 0x08) != 0;
+            break;
+        case FLAGS_INC:
+            state->cc.ac = ((x & 0x0f) == 0);
+            break;
+        case FLAGS_DEC:
+            state->cc.ac = ((x & 0x0f) != 0x0f);
+            break;
     }
-    return (0 == (p & 0x1));
+    uint8_t zsp = zsp8080[x];
+    state->cc.z = (zsp & ZSP_Z) != 0;
+    state->cc.s = (zsp & ZSP_S) != 0;
+    state->cc.p = (zsp & ZSP_P) != 0;
+    state->flag_kind = FLAGS_NONE;
 }
 
 void LogicFlags(State8080 *state)
 {
-    state->cc.cy = state->cc.ac = 0;
-    state->cc.z = (state->a ==0);
-    state->cc.s = (0x80 == (0x80 & state->a));
-    state->cc.p = Parity(state->a, 8);
+    state->flag_res = state->a;
+    state->flag_kind = FLAGS_LOGIC;
+}
+
+void ArithFlags(State8080 *state, uint8_t kind, uint8_t op1, uint8_t op2, uint16_t res)
+{
+    state->flag_res = res;
+    state->flag_op1 = op1;
+    state->flag_op2 = op2;
+    state->flag_kind = kind;
+}
+
+//INR/DCR leave carry alone, so a pending carry has to land in cc first
+void IncDecFlags(State8080 *state, uint8_t kind, uint8_t res)
+{
+    switch (state->flag_kind)
+    {
+        case FLAGS_ADD:
+        case FLAGS_SUB:
+            state->cc.cy = (state->flag_res > 0xff);
+            break;
+        case FLAGS_LOGIC:
+        case FLAGS_AND:
+            state->cc.cy = 0;
+            break;
+    }
+    state->flag_res = res;
+    state->flag_kind = kind;
+}
+
+void WriteMemSlow(State8080* state, uint16_t adr, uint8_t value)
+{
+    uint8_t flags = state->page_flags[adr >> 8];
+    if (flags & PAGE_ROM)
+        return;
+    state->memory[adr] = value;
+    if (flags & PAGE_CODE)
+        JitInvalidate(state, adr);
+#if USE_COMPUTED_GOTO
+    if (flags & PAGE_DECODED)
+        PredecodeInvalidate(state, adr);
+#endif
+    if (flags & PAGE_DIRTY)
+        state->line_dirty[adr >> 10] |= 1u << ((adr >> 5) & 31);
+    if (flags & PAGE_WATCH)
+        GdbWatchWrite(state, adr);
 }
 
-void ArithFlags(State8080 *state, uint16_t res)
+//for instructions that change carry and nothing else
+void SetCarry(State8080 *state, int cy)
 {
-    state->cc.cy = (res > 0xff);
-    state->cc.z = ((res&0xff) ==0);
-    state->cc.s = (0x80 == (res & 0x80));
-    state->cc.p = Parity(res&0xff, 8);
+    SyncFlags(state);
+    state->cc.cy = cy;
 }
 
-void UnimplementedInstructions(State8080* state){
-    printf("\nerror: Instruction Not Implemented.\n");
-    exit(1);
+//pushes the address after a 3-byte CALL and jumps to adr
+static void CallAdr(State8080* state, uint16_t adr)
+{
+    uint16_t ret = state->pc+2;
+    WriteMem(state, state->sp-1, ((ret >> 8) & 0xff));
+    WriteMem(state, state->sp-2, ret & 0xff);
+    state->sp = state->sp-2;
+    state->pc = adr;
+}
+
+static void Return(State8080* state)
+{
+    state->pc = (state->memory[(uint16_t) (state->sp+1)]<<8) | state->memory[state->sp];
+    state->sp += 2;
+}
+
+//push pc and jump, for RST and accepted interrupts
+static void Restart(State8080* state, uint16_t adr)
+{
+    WriteMem(state, state->sp-1, (state->pc >> 8) & 0xff);
+    WriteMem(state, state->sp-2, state->pc & 0xff);
+    state->sp = state->sp-2;
+    state->pc = adr;
+}
+
+//ADD/ADC, with cy the incoming carry
+static void Add(State8080* state, uint8_t value, int cy)
+{
+    uint16_t answer = (uint16_t) state->a + value + cy;
+    ArithFlags(state, FLAGS_ADD, state->a, value, answer);
+    state->a = answer & 0xff;
+}
+
+//SUB/SBB, with cy the incoming borrow
+static void Subtract(State8080* state, uint8_t value, int cy)
+{
+    uint16_t answer = (uint16_t) state->a - value - cy;
+    ArithFlags(state, FLAGS_SUB, state->a, value, answer);
+    state->a = answer & 0xff;
+}
+
+static void Compare(State8080* state, uint8_t value)
+{
+    uint16_t answer = (uint16_t) state->a - value;
+    ArithFlags(state, FLAGS_SUB, state->a, value, answer);
+}
+
+static void And(State8080* state, uint8_t value)
+{
+    uint8_t answer = state->a & value;
+    ArithFlags(state, FLAGS_AND, state->a, value, answer);
+    state->a = answer;
+}
+
+/* Decimal adjust. Carry is only ever set here, never cleared, so it
+   does not fit the lazy kinds and the flags are worked out in full. */
+static void Daa(State8080* state)
+{
+    uint8_t a = state->a;
+    uint8_t fix = 0;
+    SyncFlags(state);
+    int cy = state->cc.cy;
+    if (state->cc.ac || (a & 0x0f) > 9)
+        fix |= 0x06;
+    if (cy || (a >> 4) > 9 || ((a >> 4) >= 9 && (a & 0x0f) > 9))
+    {
+        fix |= 0x60;
+        cy = 1;
+    }
+    uint8_t x = a + fix;
+    uint8_t zsp = zsp8080[x];
+    state->a = x;
+    state->cc.cy = cy;
+    state->cc.ac = ((a ^ x) & 0x10) != 0;
+    state->cc.z = (zsp & ZSP_Z) != 0;
+    state->cc.s = (zsp & ZSP_S) != 0;
+    state->cc.p = (zsp & ZSP_P) != 0;
 }
 
 int Emulate8080(State8080* state){
     unsigned char *opcode = &state->memory[state->pc];
-    //print the next instruction to be executed
-    Disassembler(state->memory, state->pc);
+    uint16_t pc = state->pc;
+    int cycles = cycles8080[*opcode];
     state->pc +=1;
     switch (*opcode){
-        case 0x00:  break;
-        case 0x01:  state->c = opcode[1];
-                    state->b = opcode[2];
-                    state->pc +=2;
-                    break;
-        case 0x02:  UnimplementedInstructions(state); break;
-        case 0x03:  UnimplementedInstructions(state); break;
-        case 0x04:  UnimplementedInstructions(state); break;
-        case 0x05:  //DCR B
-                    {
-                    uint8_t x = state->b -1;
-                    state->cc.z = (0== x);
-                    state->cc.s = (0x80 == (x & 0x80));
-                    state->cc.p = Parity(x, 8);
-                    state->b = x;
-                    }
-                    break;
-        case 0x06:  //MVI B
-                    {
-                    state->b = opcode[1];
-                    state->pc += 1;
-                    break;
-                    }
-        case 0x07:  UnimplementedInstructions(state); break;
-        case 0x08:  UnimplementedInstructions(state); break;
-        case 0x09:  //DAD B
-                    {
-                    uint32_t hl = (state->h << 8) | state->l;
-                    uint32_t bc = (state->b << 8) | state->c;
-                    uint32_t res = hl + bc;
-                    state->h = (res & 0xff00 ) >> 8;
-                    state->l = (res & 0xff);
-                    state->cc.cy = ((res & 0xffff0000) != 0);
-                    }
-                    break;
-        case 0x0a:  UnimplementedInstructions(state); break;
-        case 0x0b:  UnimplementedInstructions(state); break;
-        case 0x0c:  UnimplementedInstructions(state); break;
-        case 0x0d:  //DCR C
-                    {
-                    uint8_t x = state->c -1;
-                    state->cc.z = (x == 0);
-                    state->cc.s = (0x80 == (x & 0x80));
-                    state->cc.p = Parity(x, 8);
-                    state->c = x;
-                    }
-                    break;
-        case 0x0e:  //MVI C
-                    {
-                    state->c = opcode[1];
-                    state->pc+=1;
-                    }
-                    break;
-        case 0x0f:  //RRC
-                    {
-                    uint8_t x = state->a;
-                    state->a = ((x & 1) << 7) | (x >> 1);
-                    state->cc.cy = (1 == (x&1));
-                    }
-                    break;
-        case 0x10:  UnimplementedInstructions(state); break;
-        case 0x11:  //LXI D
-                    {
-                    state->d = opcode[2];
-                    state->e = opcode[1];
-                    state->pc += 2;
-                    break;
-                    }
-        case 0x12:  UnimplementedInstructions(state); break;
-        case 0x13:  //INX D
-                    {
-                    state->e++;
-                    if (state->e ==0) state->d++;
-                    break;
-                    }
-        case 0x14:  UnimplementedInstructions(state); break;
-        case 0x15:  UnimplementedInstructions(state); break;
-        case 0x16:  UnimplementedInstructions(state); break;
-        case 0x17:  UnimplementedInstructions(state); break;
-        case 0x18:  UnimplementedInstructions(state); break;
-        case 0x19:  //DAD D
-                    {
-                    uint32_t hl = (state->h << 8) | state->l;
-                    uint32_t de = (state->d << 8) | state->e;
-                    uint32_t res = hl + de;
-                    state->h = (res & 0xff00 ) >> 8;
-                    state->l = (res & 0xff);
-                    state->cc.cy = ((res & 0xffff0000) != 0);
-                    }
-                    break;
-        case 0x1a:  //LDAX D
-                    {
-                    uint16_t x = (state->d <<8) | state->e; 
-                    state->a = state->memory[x];
-                    break;
-                    }
-        case 0x1b:  UnimplementedInstructions(state); break;
-        case 0x1c:  UnimplementedInstructions(state); break;
-        case 0x1d:  UnimplementedInstructions(state); break;
-        case 0x1e:  UnimplementedInstructions(state); break;
-        case 0x1f:  //RAR
-                    {
-                    uint8_t x = state->a;
-                    state->a = (state->cc.cy << 7) | (x >> 1);
-                    state->cc.cy = (1 == 1&x);
-                    }
-                    break;
-        case 0x20:  UnimplementedInstructions(state); break;
-        case 0x21:  //LXI H
-                    {
-                    state->l = opcode[1];
-                    state->h = opcode[2];
-                    state->pc += 2;
-                    break;
-                    }
-        case 0x22:  UnimplementedInstructions(state); break;
-        case 0x23:  //INX H
-                    {
-                    state->l++;
-                    if (state->l ==0) state->h++;
-                    break;
-                    }
-        case 0x24:  UnimplementedInstructions(state); break;
-        case 0x25:  UnimplementedInstructions(state); break;
-        case 0x26:  //MVI H
-                    {
-                    state->h = opcode[1];
-                    state->pc += 1;
-                    }
-                    break;
-        case 0x27:  UnimplementedInstructions(state); break;
-        case 0x28:  UnimplementedInstructions(state); break;
-        case 0x29:  //DAD H
-                    {
-                    uint32_t x = (state->h << 8) | (state->l);
-                    uint32_t hl = x +x;
-                    state->h = (hl & 0xff00) >> 8;
-                    state->l = hl & 0xff;
-                    state->cc.cy = ((hl & 0xffff0000) != 0);
-                    }
-                    break;
-        case 0x2a:  UnimplementedInstructions(state); break;
-        case 0x2b:  UnimplementedInstructions(state); break;
-        case 0x2c:  UnimplementedInstructions(state); break;
-        case 0x2d:  UnimplementedInstructions(state); break;
-        case 0x2e:  UnimplementedInstructions(state); break;
-        case 0x2f:  //CMA
-                    {
-                    state->a = ~state->a;
-                    break;
-                    }
-        case 0x30:  UnimplementedInstructions(state); break;
-        case 0x31:  //LXI SP
-                    {
-                    state->sp = (opcode[2] << 8) | opcode[1];
-                    state->pc += 2;
-                    break;
-                    }
-        case 0x32:  //STA adr
-                    {
-                    uint16_t adr = (opcode[2]<<8) | opcode[1];
-                    state->memory[adr] = state->a;
-                    state->pc +=2;
-                    }
-                    break;
-        case 0x33:  UnimplementedInstructions(state); break;
-        case 0x34:  UnimplementedInstructions(state); break;
-        case 0x35:  UnimplementedInstructions(state); break;
-        case 0x36:  //MVI M
-                    {
-                    uint16_t x = (state->h << 8) | state-> l;
-                    state->memory[x] = opcode[1];
-                    state->pc++;
-                    }
-                    break;
-        case 0x37:  UnimplementedInstructions(state); break;
-        case 0x38:  UnimplementedInstructions(state); break;
-        case 0x39:  UnimplementedInstructions(state); break;
-        case 0x3a:  //LDA adr
-                    {
-                    uint16_t x = (opcode[2] <<8) | opcode[1];
-                    state->a = state->memory[x];
-                    state->pc +=2;
-                    }
-                    break;
-        case 0x3b:  UnimplementedInstructions(state); break;
-        case 0x3c:  UnimplementedInstructions(state); break;
-        case 0x3d:  UnimplementedInstructions(state); break;
-        case 0x3e:  //MVI A
-                    {
-                    state->a = opcode[1];
-                    state->pc += 1;
-                    }
-                    break;
-        case 0x3f:  UnimplementedInstructions(state); break;
-        case 0x40:  UnimplementedInstructions(state); break;
-        case 0x41:  state->b = state->c; break;
-        case 0x42:  state->b = state->d; break;
-        case 0x43:  state->b = state->e; break;
-        case 0x44:  UnimplementedInstructions(state); break;
-        case 0x45:  UnimplementedInstructions(state); break;
-        case 0x46:  UnimplementedInstructions(state); break;
-        case 0x47:  UnimplementedInstructions(state); break;
-        case 0x48:  UnimplementedInstructions(state); break;
-        case 0x49:  UnimplementedInstructions(state); break;
-        case 0x4a:  UnimplementedInstructions(state); break;
-        case 0x4b:  UnimplementedInstructions(state); break;
-        case 0x4c:  UnimplementedInstructions(state); break;
-        case 0x4d:  UnimplementedInstructions(state); break;
-        case 0x4e:  UnimplementedInstructions(state); break;
-        case 0x4f:  UnimplementedInstructions(state); break;
-        case 0x50:  UnimplementedInstructions(state); break;
-        case 0x51:  UnimplementedInstructions(state); break;
-        case 0x52:  UnimplementedInstructions(state); break;
-        case 0x53:  UnimplementedInstructions(state); break;
-        case 0x54:  UnimplementedInstructions(state); break;
-        case 0x55:  UnimplementedInstructions(state); break;
-        case 0x56:  //MOV D,M
-                    {
-                    uint16_t x = (state->h << 8) | state->l;
-                    state->d = state->memory[x];
-                    break;
-                    }
-        case 0x57:  UnimplementedInstructions(state); break;
-        case 0x58:  UnimplementedInstructions(state); break;
-        case 0x59:  UnimplementedInstructions(state); break;
-        case 0x5a:  UnimplementedInstructions(state); break;
-        case 0x5b:  UnimplementedInstructions(state); break;
-        case 0x5c:  UnimplementedInstructions(state); break;
-        case 0x5d:  UnimplementedInstructions(state); break;
-        case 0x5e:  //MOV E,M
-                    {
-                    uint16_t x = (state->h << 8) | state->l;
-                    state->e = state->memory[x];
-                    break;
-                    }
-        case 0x5f:  UnimplementedInstructions(state); break;
-        case 0x60:  UnimplementedInstructions(state); break;
-        case 0x61:  UnimplementedInstructions(state); break;
-        case 0x62:  UnimplementedInstructions(state); break;
-        case 0x63:  UnimplementedInstructions(state); break;
-        case 0x64:  UnimplementedInstructions(state); break;
-        case 0x65:  UnimplementedInstructions(state); break;
-        case 0x66:  //MOV H,M
-                    {
-                    uint16_t x = (state->h << 8) | state->l;
-                    state->h = state->memory[x];
-                    break;
-                    }
-        case 0x67:  UnimplementedInstructions(state); break;
-        case 0x68:  UnimplementedInstructions(state); break;
-        case 0x69:  UnimplementedInstructions(state); break;
-        case 0x6a:  UnimplementedInstructions(state); break;
-        case 0x6b:  UnimplementedInstructions(state); break;
-        case 0x6c:  UnimplementedInstructions(state); break;
-        case 0x6d:  UnimplementedInstructions(state); break;
-        case 0x6e:  UnimplementedInstructions(state); break;
-        case 0x6f:  //MOV LA
-                    {
-                    state->l = state->a;
-                    }
-                    break;
-        case 0x70:  UnimplementedInstructions(state); break;
-        case 0x71:  UnimplementedInstructions(state); break;
-        case 0x72:  UnimplementedInstructions(state); break;
-        case 0x73:  UnimplementedInstructions(state); break;
-        case 0x74:  UnimplementedInstructions(state); break;
-        case 0x75:  UnimplementedInstructions(state); break;
-        case 0x76:  UnimplementedInstructions(state); break;
-        case 0x77:  //MOV M,A
-                    {
-                    uint16_t x = (state->h << 8) | state->l;
-                    state->memory[x] = state->a;
-                    }
-                    break;
-        case 0x78:  UnimplementedInstructions(state); break;
-        case 0x79:  UnimplementedInstructions(state); break;
-        case 0x7a:  //MOV A,D
-                    {
-                    state->a = state->d;
-                    }
-                    break;
-        case 0x7b:  //MOV A,E
-                    {
-                    state->a = state->e;
-                    }
-                    break;
-        case 0x7c:  //MOV A,H
-                    {
-                    state->a = state->h;
-                    break;
-                    }
-                    break;
-        case 0x7d:  UnimplementedInstructions(state); break;
-        case 0x7e:  //MOV A,M
-                    {
-                    uint16_t x = (state->h << 8) | state->l;
-                    state->a = state->memory[x];
-                    break;
-                    }
-        case 0x7f:  UnimplementedInstructions(state); break;
-        case 0x80:  //ADD B
-                {
-                    uint16_t answer = (uint16_t) state->a + (uint16_t) state->b;
-                    //zero flag
-                    if ((answer & 0xff)==0)
-                        state->cc.z =1;
-                    else
-                        state->cc.z=0;
-                    //sign flag
-                    if ((answer & 0x80) ==0)
-                        state->cc.s=1;
-                    else
-                        state->cc.s=0;
-                    //carry flag
-                    if (answer > 0xff)
-                        state->cc.cy =1;
-                    else
-                        state->cc.cy=0;
-                    
-                    //parity flag
-                    state->cc.p = Parity(answer, 8);
-
-                    //accumulator
-                    state->a = (answer & 0xff);
-                }
-                break;
-        case 0x81:  //Add C
-                    { 
-                    uint16_t answer = (uint16_t) state->a + (uint16_t) state->c;
-                    //zero flag
-                    state->cc.z = (0 == (answer & 0xff));
-                    //sign flag
-                    state->cc.s = (0 != (answer & 0x80));
-                    //carry flag
-                    state->cc.cy = (answer> 0xff);
-                    //parity flag
-                    state->cc.p = Parity(answer, 8);
-                    //accumulator
-                    state->a = answer;
-                    }
-                    break;
-        case 0x82:  UnimplementedInstructions(state); break;
-        case 0x83:  UnimplementedInstructions(state); break;
-        case 0x84:  UnimplementedInstructions(state); break;
-        case 0x85:  UnimplementedInstructions(state); break;
-        case 0x86:  //ADD M
-                    {
-                        uint16_t offset = (state->h << 8) | (state-> l);
-                        uint16_t answer = (uint16_t) state->a + (uint16_t) state->memory[offset];
-                        state->cc.z = (0 == (answer & 0xff));
-                        state->cc.s = (0 != (answer & 0x80));
-                        state->cc.p = Parity(answer, 8);
-                        state->a = answer;
-                    }
-                    break;
-        case 0x87:  UnimplementedInstructions(state); break;
-        case 0x88:  UnimplementedInstructions(state); break;
-        case 0x89:  UnimplementedInstructions(state); break;
-        case 0x8a:  UnimplementedInstructions(state); break;
-        case 0x8b:  UnimplementedInstructions(state); break;
-        case 0x8c:  UnimplementedInstructions(state); break;
-        case 0x8d:  UnimplementedInstructions(state); break;
-        case 0x8e:  UnimplementedInstructions(state); break;
-        case 0x8f:  UnimplementedInstructions(state); break;
-        case 0x90:  UnimplementedInstructions(state); break;
-        case 0x91:  UnimplementedInstructions(state); break;
-        case 0x92:  UnimplementedInstructions(state); break;
-        case 0x93:  UnimplementedInstructions(state); break;
-        case 0x94:  UnimplementedInstructions(state); break;
-        case 0x95:  UnimplementedInstructions(state); break;
-        case 0x96:  UnimplementedInstructions(state); break;
-        case 0x97:  UnimplementedInstructions(state); break;
-        case 0x98:  UnimplementedInstructions(state); break;
-        case 0x99:  UnimplementedInstructions(state); break;
-        case 0x9a:  UnimplementedInstructions(state); break;
-        case 0x9b:  UnimplementedInstructions(state); break;
-        case 0x9c:  UnimplementedInstructions(state); break;
-        case 0x9d:  UnimplementedInstructions(state); break;
-        case 0x9e:  UnimplementedInstructions(state); break;
-        case 0x9f:  UnimplementedInstructions(state); break;
-        case 0xa0:  UnimplementedInstructions(state); break;
-        case 0xa1:  UnimplementedInstructions(state); break;
-        case 0xa2:  UnimplementedInstructions(state); break;
-        case 0xa3:  UnimplementedInstructions(state); break;
-        case 0xa4:  UnimplementedInstructions(state); break;
-        case 0xa5:  UnimplementedInstructions(state); break;
-        case 0xa6:  UnimplementedInstructions(state); break;
-        case 0xa7:  // ANA A
-                    {
-                    state->a = state->a & state->a;
-                    LogicFlags(state);
-                    break;
-                    }
-        case 0xa8:  UnimplementedInstructions(state); break;
-        case 0xa9:  UnimplementedInstructions(state); break;
-        case 0xaa:  UnimplementedInstructions(state); break;
-        case 0xab:  UnimplementedInstructions(state); break;
-        case 0xac:  UnimplementedInstructions(state); break;
-        case 0xad:  UnimplementedInstructions(state); break;
-        case 0xae:  UnimplementedInstructions(state); break;
-        case 0xaf:  //XRA A
-                    {
-                    state->a = state->a^state->a;
-                    LogicFlags(state);
-                    }
-                    break;
-        case 0xb0:  UnimplementedInstructions(state); break;
-        case 0xb1:  UnimplementedInstructions(state); break;
-        case 0xb2:  UnimplementedInstructions(state); break;
-        case 0xb3:  UnimplementedInstructions(state); break;
-        case 0xb4:  UnimplementedInstructions(state); break;
-        case 0xb5:  UnimplementedInstructions(state); break;
-        case 0xb6:  UnimplementedInstructions(state); break;
-        case 0xb7:  UnimplementedInstructions(state); break;
-        case 0xb8:  UnimplementedInstructions(state); break;
-        case 0xb9:  UnimplementedInstructions(state); break;
-        case 0xba:  UnimplementedInstructions(state); break;
-        case 0xbb:  UnimplementedInstructions(state); break;
-        case 0xbc:  UnimplementedInstructions(state); break;
-        case 0xbd:  UnimplementedInstructions(state); break;
-        case 0xbe:  UnimplementedInstructions(state); break;
-        case 0xbf:  UnimplementedInstructions(state); break;
-        case 0xc0:  UnimplementedInstructions(state); break;
-        case 0xc1:  //POP B
-                    {
-                    state->b = state->memory[state->sp+1];
-                    state->c = state->memory[state->sp];
-                    state->sp +=2;
-                    }
-                    break;
-        case 0xc2:  //JNZ
-                    {
-                    if (!(state->cc.z)) state->pc = (opcode[2] << 8) | opcode[1];
-                    else state->pc += 2; 
-                    }
-                    break;
-        case 0xc3:  //JMP
-                    {
-                    state->pc = (opcode[2] << 8) | opcode[1];
-                    break;
-                    }
-        case 0xc4:  UnimplementedInstructions(state); break;
-        case 0xc5:  //PUSH B
-                    {
-                    state->memory[state->sp-2] = state->c;
-                    state->memory[state->sp-1] = state->b;
-                    state->sp -= 2;
-                    }
-                    break;
-        case 0xc6:  //ADI
-                    {
-                    uint16_t answer = (uint16_t) state->a + (uint16_t) opcode[1];
-                    state->cc.z = (0 == (answer & 0xff));
-                    state->cc.s = (0 != (answer & 0x80));
-                    state->cc.cy = (answer > 0xff);
-                    state->cc.p = Parity(answer, 8);
-                    state->a = answer; 
-                    }
-                    break;
-        case 0xc7:  UnimplementedInstructions(state); break;
-        case 0xc8:  UnimplementedInstructions(state); break;
-        case 0xc9:  //RET
-                    {
-                    state->pc = (state->memory[state->sp+1]<<8) | state->memory[state->sp];
-                    state->sp += 2;
-                    break;
-                    }
-        case 0xca:  UnimplementedInstructions(state); break;
-        case 0xcb:  UnimplementedInstructions(state); break;
-        case 0xcc:  UnimplementedInstructions(state); break;
-        case 0xcd:  //CALL 
-                    {
-                    uint16_t ret = state->pc+2;
-                    state->memory[state->sp-1] = ((ret >> 8) & 0xff);
-                    state->memory[state->sp-2] = ret & 0xff;
-                    state->sp = state->sp-2;
-                    state->pc = (opcode[2] << 8) | opcode[1];
-                    }
-                    break;
-        case 0xce:  UnimplementedInstructions(state); break;
-        case 0xcf:  UnimplementedInstructions(state); break;
-        case 0xd0:  UnimplementedInstructions(state); break;
-        case 0xd1:  //POP D
-                    {
-                    state->d = state->memory[state->sp+1];
-                    state->e = state->memory[state->sp];
-                    state->sp +=2;
-                    }
-                    break;
-        case 0xd2:  UnimplementedInstructions(state); break;
-        case 0xd3:  //OUT
-                    {
-                    state->pc++;
-                    }
-                    break;
-        case 0xd4:  UnimplementedInstructions(state); break;
-        case 0xd5:  //PUSH D
-                    {
-                    state->memory[state->sp -1] = state->d;
-                    state->memory[state->sp -2] = state->e;
-                    state->sp -= 2; 
-                    }
-                    break;
-        case 0xd6:  UnimplementedInstructions(state); break;
-        case 0xd7:  UnimplementedInstructions(state); break;
-        case 0xd8:  UnimplementedInstructions(state); break;
-        case 0xd9:  UnimplementedInstructions(state); break;
-        case 0xda:  UnimplementedInstructions(state); break;
-        case 0xdb:  UnimplementedInstructions(state); break;
-        case 0xdc:  UnimplementedInstructions(state); break;
-        case 0xdd:  UnimplementedInstructions(state); break;
-        case 0xde:  UnimplementedInstructions(state); break;
-        case 0xdf:  UnimplementedInstructions(state); break;
-        case 0xe0:  UnimplementedInstructions(state); break;
-        case 0xe1:  //POP H
-                    {
-                    state->h = state->memory[state->sp+1];
-                    state->l = state->memory[state->sp];
-                    state->sp +=2;
-                    }
-                    break;
-        case 0xe2:  UnimplementedInstructions(state); break;
-        case 0xe3:  UnimplementedInstructions(state); break;
-        case 0xe4:  UnimplementedInstructions(state); break;
-        case 0xe5:  //PUSH H
-                    {
-                    state->memory[state->sp -1] = state-> h;
-                    state->memory[state->sp -2] = state->l;
-                    state->sp -= 2;
-                    }
-                    break;
-        case 0xe6:  //ANI
-                    {
-                    uint8_t x = state->a & opcode[1];
-                    state->cc.z = (x==0);
-                    state->cc.s = (0 != (x & 0x80));
-                    state->cc.p = Parity(x, 8);
-                    state->cc.cy = 0;
-                    state->a = x;
-                    state->pc++;
-                    }
-                    break;
-        case 0xe7:  UnimplementedInstructions(state); break;
-        case 0xe8:  UnimplementedInstructions(state); break;
-        case 0xe9:  UnimplementedInstructions(state); break;
-        case 0xea:  UnimplementedInstructions(state); break;
-        case 0xeb:  //XCHG
-                    {
-                    uint8_t x = state->d;
-                    uint8_t y = state->e;
-                    state->d = state->h;
-                    state->e = state->l;
-                    state->h = x;
-                    state->l = y;
-                    }
-                    break;
-        case 0xec:  UnimplementedInstructions(state); break;
-        case 0xed:  UnimplementedInstructions(state); break;
-        case 0xee:  UnimplementedInstructions(state); break;
-        case 0xef:  UnimplementedInstructions(state); break;
-        case 0xf0:  UnimplementedInstructions(state); break;
-        case 0xf1:  //POP PSW
-                    {
-                    state->a = state->memory[state->sp+1];
-                    uint8_t x= state->memory[state->sp];
-                    state->cc.z = (0x1 == (x & 0x1));
-                    state->cc.s = (0x2 == (x & 0x2));
-                    state->cc.p = (0x4 == (x & 0x4));
-                    state->cc.cy = (0x5 == (x & 0x5));
-                    state->cc.ac = (0x10 == (x & 0x10));
-                    state->sp += 2;   
-                    }
-                    break;
-        case 0xf2:  UnimplementedInstructions(state); break;
-        case 0xf3:  UnimplementedInstructions(state); break;
-        case 0xf4:  UnimplementedInstructions(state); break;
-        case 0xf5:  //PUSH PSW
-                    {
-                    state-> memory[state->sp-1] = state->a;
-                    uint8_t x = (state->cc.z |    
-                            state->cc.s << 1 |    
-                            state->cc.p << 2 |    
-                            state->cc.cy << 3 |    
-                            state->cc.ac << 4 );
-                    state->memory[state->sp-2] = x;    
-                    state->sp = state->sp - 2;    
-                    }    
-                    break;
-        case 0xf6:  UnimplementedInstructions(state); break;
-        case 0xf7:  UnimplementedInstructions(state); break;
-        case 0xf8:  UnimplementedInstructions(state); break;
-        case 0xf9:  UnimplementedInstructions(state); break;
-        case 0xfa:  UnimplementedInstructions(state); break;
-        case 0xfb:  //EI
-                    {
-                    state->int_enable = 1;
-                    break;
-                    }
-        case 0xfc:  UnimplementedInstructions(state); break;
-        case 0xfd:  UnimplementedInstructions(state); break;
-        case 0xfe:  //CPI
-                    {
-                    uint8_t x = state->a - opcode[1];
-                    state->cc.z = (0== x);
-                    state->cc.cy = (0 > x);
-                    state->cc.s = (0x80 == (x & 0x80));
-                    state->cc.p = Parity(x, 8);
-                    state->pc++;
-                    }
-                    break;
-        case 0xff:  UnimplementedInstructions(state); break;
+#define OP(n)   case n
+#define NEXT    break
+#define IMM8    state->memory[(uint16_t) (pc + 1)]
+#define IMM16   ((state->memory[(uint16_t) (pc + 2)] << 8) | state->memory[(uint16_t) (pc + 1)])
+#define STOP()  (state->stop = 1)
+#include "ops8080.h"
+#undef OP
+#undef NEXT
+#undef IMM8
+#undef IMM16
+#undef STOP
+    }
+    if (state->trace)
+        TraceStep(state->trace, state, pc);
+    if (state->profile)
+        ProfileStep(state->profile, state, pc, opcode, cycles);
+    state->cycles += cycles;
+    state->instructions++;
+    return cycles;
+}
 
+/* Executes instructions until at least `cycles` clock cycles have gone
+   by and returns how far the last instruction ran past the budget, so
+   the caller can take it off the next slice. */
+int Run8080Switch(State8080* state, int cycles)
+{
+    uint64_t end = state->cycles + cycles;
+    while (state->cycles < end && !state->stop)
+        Emulate8080(state);
+    return (int) (state->cycles - end);
+}
+
+#if USE_COMPUTED_GOTO
+//label addresses of every handler, for use inside a threaded core
+#define DISPATCH_TABLE { \
+        &&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07, \
+        &&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f, \
+        &&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17, \
+        &&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f, \
+        &&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27, \
+        &&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f, \
+        &&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37, \
+        &&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f, \
+        &&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47, \
+        &&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f, \
+        &&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57, \
+        &&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f, \
+        &&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67, \
+        &&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f, \
+        &&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77, \
+        &&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f, \
+        &&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87, \
+        &&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f, \
+        &&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97, \
+        &&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f, \
+        &&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7, \
+        &&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf, \
+        &&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7, \
+        &&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf, \
+        &&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7, \
+        &&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf, \
+        &&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7, \
+        &&op_0xd8, &&op_0xd9, &&op_0xda, &&op_0xdb, &&op_0xdc, &&op_0xdd, &&op_0xde, &&op_0xdf, \
+        &&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3, &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7, \
+        &&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb, &&op_0xec, &&op_0xed, &&op_0xee, &&op_0xef, \
+        &&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7, \
+        &&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_0xfc, &&op_0xfd, &&op_0xfe, &&op_0xff, \
     }
-    printf("\t");
-	printf("%c", state->cc.z ? 'z' : '.');
-	printf("%c", state->cc.s ? 's' : '.');
-	printf("%c", state->cc.p ? 'p' : '.');
-	printf("%c", state->cc.cy ? 'c' : '.');
-	printf("%c  ", state->cc.ac ? 'a' : '.');
-	printf("A $%02x B $%02x C $%02x D $%02x E $%02x H $%02x L $%02x SP %04x\n", state->a, state->b, state->c,
-				state->d, state->e, state->h, state->l, state->sp);
-    
-    
-    return 0;
+
+/* Same contract as Run8080Switch, but the instruction loop is threaded:
+   every handler ends in its own fetch and indirect jump through
+   `dispatch`, so the branch predictor sees one branch per opcode instead
+   of the single shared one at the top of a switch. */
+int Run8080Threaded(State8080* state, int budget)
+{
+    static void *dispatch[256] = DISPATCH_TABLE;
+    uint64_t end = state->cycles + budget;
+    uint64_t limit = end;       //STOP() drops it to 0; end stays for the result
+    unsigned char *opcode;
+    uint16_t pc;
+    int cycles;
+
+#define DISPATCH()  do { \
+                        opcode = &state->memory[state->pc]; \
+                        pc = state->pc; \
+                        cycles = cycles8080[*opcode]; \
+                        state->pc += 1; \
+                        goto *dispatch[*opcode]; \
+                    } while (0)
+#define OP(n)   op_##n
+#define STOP()  (limit = 0)
+#define IMM8    state->memory[(uint16_t) (pc + 1)]
+#define IMM16   ((state->memory[(uint16_t) (pc + 2)] << 8) | state->memory[(uint16_t) (pc + 1)])
+#define NEXT    do { \
+                    if (state->trace) \
+                        TraceStep(state->trace, state, pc); \
+                    if (state->profile) \
+                        ProfileStep(state->profile, state, pc, opcode, cycles); \
+                    state->cycles += cycles; \
+                    state->instructions++; \
+                    if (state->cycles >= limit) \
+                        goto done; \
+                    DISPATCH(); \
+                } while (0)
+
+    if (state->cycles >= end)
+        goto done;
+    DISPATCH();
+#include "ops8080.h"
+#undef OP
+#undef NEXT
+#undef IMM8
+#undef IMM16
+#undef STOP
+#undef DISPATCH
+
+done:
+    return (int) (state->cycles - end);
+}
+
+Predecode8080* PredecodeCreate(void)
+{
+    return calloc(1, sizeof(Predecode8080));
+}
+
+void PredecodeFree(Predecode8080* cache)
+{
+    free(cache);
+}
+
+/* Called from WriteMemSlow: the store may have changed the opcode or an
+   operand of an instruction starting up to two bytes earlier. */
+void PredecodeInvalidate(State8080* state, uint16_t adr)
+{
+    Predecode8080 *cache = state->decoded;
+    for (int i = 0; i < 3; i++)
+        cache->entries[(uint16_t) (adr - i)].handler = cache->miss;
+}
+
+/* The threaded core again, but dispatching through state->decoded: the
+   handler, operand word and cycle cost of each pc are worked out the
+   first time it runs and reused until a store invalidates them. */
+int Run8080Predecoded(State8080* state, int budget)
+{
+    static void *dispatch[256] = DISPATCH_TABLE;
+    Predecode8080 *cache = state->decoded;
+    uint64_t end = state->cycles + budget;
+    uint64_t limit = end;       //STOP() drops it to 0; end stays for the result
+    Decoded8080 *d;
+    uint16_t pc;
+    int cycles;
+
+    if (cache->miss == NULL)
+    {
+        cache->miss = &&decode;
+        for (int i = 0; i < 0x10000; i++)
+            cache->entries[i].handler = &&decode;
+    }
+
+#define DISPATCH()  do { \
+                        pc = state->pc; \
+                        d = &cache->entries[pc]; \
+                        cycles = d->cycles; \
+                        state->pc += 1; \
+                        goto *d->handler; \
+                    } while (0)
+#define OP(n)   op_##n
+#define STOP()  (limit = 0)
+#define IMM8    ((uint8_t) d->imm)
+#define IMM16   (d->imm)
+#define NEXT    do { \
+                    if (state->trace) \
+                        TraceStep(state->trace, state, pc); \
+                    if (state->profile) \
+                        ProfileStep(state->profile, state, pc, &state->memory[pc], cycles); \
+                    state->cycles += cycles; \
+                    state->instructions++; \
+                    if (state->cycles >= limit) \
+                        goto done; \
+                    DISPATCH(); \
+                } while (0)
+
+    if (state->cycles >= end)
+        goto done;
+    DISPATCH();
+
+decode:
+    {
+        uint8_t op = state->memory[pc];
+        d->handler = dispatch[op];
+        d->imm = (state->memory[(uint16_t) (pc + 2)] << 8) | state->memory[(uint16_t) (pc + 1)];
+        d->cycles = cycles = cycles8080[op];
+        d->len = lengths8080[op];
+        state->page_flags[pc >> 8] |= PAGE_DECODED;
+        state->page_flags[(uint16_t) (pc + d->len - 1) >> 8] |= PAGE_DECODED;
+        //a breakpoint keeps this entry pointing at brk until it is cleared
+        if (state->breakpoints && (state->breakpoints[pc >> 3] >> (pc & 7) & 1))
+            d->handler = &&brk;
+        goto *d->handler;
+    }
+
+brk:
+    state->pc = pc;
+    state->trap = TRAP_BREAK;
+    goto done;
+#include "ops8080.h"
+#undef OP
+#undef NEXT
+#undef IMM8
+#undef IMM16
+#undef STOP
+#undef DISPATCH
+
+done:
+    return (int) (state->cycles - end);
+}
+#endif
+
+static void RunCore(State8080* state, int cycles)
+{
+    if (state->gdb)
+        GdbRun(state, cycles);
+    else if (state->jit && !state->trace && !state->profile)
+        JitRun(state, cycles);
+#if USE_COMPUTED_GOTO
+    else if (state->decoded)
+        Run8080Predecoded(state, cycles);
+    else
+        Run8080Threaded(state, cycles);
+#else
+    else
+        Run8080Switch(state, cycles);
+#endif
+}
+
+//vector to the waiting interrupt if the CPU will take it now
+void Accept8080(State8080* state)
+{
+    if (!state->int_pending || !state->int_enable)
+        return;
+    //EI holds interrupts off until the instruction after it is done; it
+    //runs on the current core so breakpoints and the JIT see it too, and
+    //again if the debugger stopped in front of it
+    while (state->cycles == state->ei_done)
+    {
+        RunCore(state, 1);
+        state->stop = 0;
+    }
+    if (!state->int_enable)
+        return;
+
+    uint8_t rst = state->int_rst;
+    if (state->replay)
+        rst = ReplayInterrupt(state, rst);
+    state->int_pending = 0;
+    state->int_enable = 0;
+    state->halted = 0;
+    Restart(state, rst * 8);
+    if (state->profile)
+        ProfileInterrupt(state->profile, state);
+    state->cycles += cycles8080[0xc7];
+    state->instructions++;
 }
 
+/* The cores plus interrupts: a waiting interrupt is taken before the
+   slice and wherever a core stops early (EI with one waiting, HLT). A
+   halted CPU skips straight to the end of the slice. */
+int Run8080(State8080* state, int cycles)
+{
+    uint64_t end = state->cycles + cycles;
+    while (state->cycles < end)
+    {
+        Accept8080(state);
+        if (state->halted)
+        {
+            state->cycles = end;
+            break;
+        }
+        state->stop = 0;
+        RunCore(state, (int) (end - state->cycles));
+    }
+    state->stop = 0;
+    return (int) (state->cycles - end);
+}
 
 void ReadFile(State8080* state, char* filename, uint32_t offset)
 {
@@ -705,6 +556,11 @@ void ReadFile(State8080* state, char* filename, uint32_t offset)
 	fseek(fp, 0L, SEEK_END);
 	int fsize = ftell(fp);
 	fseek(fp, 0L, SEEK_SET);
+	if (offset + fsize > 0x10000)
+	{
+		printf("error: %s at $%04x runs past the 64K address space\n", filename, offset);
+		exit(1);
+	}
 
 	uint8_t *buffer = &state->memory[offset];
     
@@ -715,67 +571,126 @@ void ReadFile(State8080* state, char* filename, uint32_t offset)
 State8080* Initialize8080(void)
 {   
     State8080* state = calloc(1, sizeof(State8080));
-    state->memory = malloc(0x10000);
+    state->memory = calloc(1, 0x10000);
+    PortReset(state);
     return state;
 }
 
--(uint8_t) MachineIn(uint8_t port)
+//marks the pages wholly inside [start, end) as ROM; guest stores there
+//are dropped
+void ProtectRom(State8080* state, uint32_t start, uint32_t end)
 {
-    uint8_t a;
-    switch(port)
-    {
-        case 3:
-        {
-            uint16_t v = (shift << 8) | shift0;
-            a = ((v>> (8-shift_offset)) & 0xff);
-        }
-        break;
-    }
-    return a;
+    for (uint32_t page = (start + 0xff) >> 8; page < (end >> 8); page++)
+        state->page_flags[page] |= PAGE_ROM;
 }
 
-void MachineOut (uint8_t port, uint8_t value)
+void Free8080(State8080* state)
 {
-    switch(port)
-    {
-        case 2:
-            shift_offset = value & 0x7;
-            break;
-        case 4:
-            shift0 = shift1;
-            shift1 = value;
-            break;
-    }
+    TraceFree(state->trace);
+    JitFree(state->jit);
+    ReplayFree(state->replay);
+    ProfileFree(state->profile);
+    GdbFree(state->gdb);
+    free(state->breakpoints);
+#if USE_COMPUTED_GOTO
+    PredecodeFree(state->decoded);
+#endif
+    if (state->memory_mapped)
+        munmap(state->memory, 0x10000);
+    else
+        free(state->memory);
+    free(state);
 }
 
-int main(int argc, char**argv)
+/* Raises the interrupt line with an RST number. It stays raised until
+   the CPU accepts it, which Run8080 does as soon as interrupts are on. */
+void Interrupt8080(State8080* state, uint8_t rst)
 {
-    int done = 0;
-    int vblankcycles = 0;
-    State8080* state = Initialize8080();
+    state->int_pending = 1;
+    state->int_rst = rst & 7;
+}
 
-    ReadFile(state, "invaders.h", 0);
-    ReadFile(state, "invaders.g", 0x800);
-    ReadFile(state, "invaders.f", 0x1000);
-    ReadFile(state, "invaders.e", 0x1800);
+//the video hardware interrupts with RST 1 at mid-screen and RST 2 at
+//vblank; call at the end of each half-frame slice
+void MachineInterrupt(State8080* state, int half_frame_cycles)
+{
+    Interrupt8080(state, (state->cycles / half_frame_cycles) % 2 ? 1 : 2);
+}
+
+static uint8_t OpenIn(void *ctx, uint8_t port)
+{
+    (void) ctx;
+    (void) port;
+    return 0;
+}
 
-    while (done == 0)
+static void OpenOut(void *ctx, uint8_t port, uint8_t value)
+{
+    (void) ctx;
+    (void) port;
+    (void) value;
+}
+
+//disconnect every port
+void PortReset(State8080* state)
+{
+    for (int port = 0; port < 256; port++)
     {
-        uint8_t opcode = state->memory[state->pc];
-        if (*opcode == 0xdb) //IN
-        {
-            uint8_t port = opcode[1];
-            state->a = MachineIn(state, port);
-            state->pc++;
-        }
-        else if (*opcode == 0xd3) //OUT
-        {
-            uint8_t port = opcode[1];
-            MachineOut(state, port);
-            
-        }
-        else
-            done = Emulate8080(state);
+        PortMapIn(state, port, OpenIn, NULL);
+        PortMapOut(state, port, OpenOut, NULL);
     }
-    return 0;
-}
\ No newline at end of file
+}
+
+void PortMapIn(State8080* state, uint8_t port, PortIn fn, void *ctx)
+{
+    state->bus.in[port] = fn;
+    state->bus.in_ctx[port] = ctx;
+}
+
+void PortMapOut(State8080* state, uint8_t port, PortOut fn, void *ctx)
+{
+    state->bus.out[port] = fn;
+    state->bus.out_ctx[port] = ctx;
+}
+
+//IN 0..2: the input latches
+static uint8_t LatchIn(void *ctx, uint8_t port)
+{
+    MachineIO *io = ctx;
+    return io->in[port];
+}
+
+//IN 3: the shift register, read at the offset set by OUT 2
+static uint8_t ShiftIn(void *ctx, uint8_t port)
+{
+    MachineIO *io = ctx;
+    (void) port;
+    uint16_t v = (io->shift1 << 8) | io->shift0;
+    return (v >> (8 - io->shift_offset)) & 0xff;
+}
+
+static void ShiftOffsetOut(void *ctx, uint8_t port, uint8_t value)
+{
+    MachineIO *io = ctx;
+    (void) port;
+    io->shift_offset = value & 0x7;
+}
+
+//OUT 4: shift a new byte in from the top
+static void ShiftDataOut(void *ctx, uint8_t port, uint8_t value)
+{
+    MachineIO *io = ctx;
+    (void) port;
+    io->shift0 = io->shift1;
+    io->shift1 = value;
+}
+
+//connect the invaders board, backed by state->io
+void MachineAttach(State8080* state)
+{
+    for (int port = 0; port < 3; port++)
+        PortMapIn(state, port, LatchIn, &state->io);
+    PortMapIn(state, 3, ShiftIn, &state->io);
+    PortMapOut(state, 2, ShiftOffsetOut, &state->io);
+    PortMapOut(state, 4, ShiftDataOut, &state->io);
+}
@@ -0,0 +1,200 @@
+#ifndef EMULATOR
+#define EMULATOR
+
+#include <stdint.h>
+
+/* The threaded core needs the GCC/Clang labels-as-values extension.
+   Build with -DNO_COMPUTED_GOTO to fall back to the switch core. */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO   1
+#else
+#define USE_COMPUTED_GOTO   0
+#endif
+
+typedef struct ConditionCodes{
+    uint8_t     z:1;
+    uint8_t     p:1;
+    uint8_t     s:1;
+    uint8_t     cy:1;
+    uint8_t     ac:1;
+    uint8_t     pad:3;
+}ConditionCodes;
+
+struct Trace8080;
+struct Jit8080;
+struct Replay8080;
+struct Gdb8080;
+
+//bits in State8080.page_flags; any set bit sends writes to WriteMemSlow
+#define PAGE_CODE   0x01    //holds code the JIT has translated
+#define PAGE_DECODED 0x02   //holds instructions in the predecode cache
+#define PAGE_ROM    0x04    //read-only, stores are dropped
+#define PAGE_DIRTY  0x08    //stores mark their 32-byte line in line_dirty
+#define PAGE_WATCH  0x10    //holds an address the debugger watches for writes
+
+//one pc's worth of the predecode cache
+typedef struct Decoded8080{
+    void        *handler;   //threaded-core label, or the decode label
+    uint16_t    imm;        //operand word (low byte for 2-byte ops)
+    uint8_t     cycles;
+    uint8_t     len;
+}Decoded8080;
+
+typedef struct Predecode8080{
+    void        *miss;      //decode label, set on the first run
+    Decoded8080 entries[0x10000];
+}Predecode8080;
+
+//what the pending lazy flags in State8080 came from
+enum {
+    FLAGS_NONE,     //cc is up to date
+    FLAGS_ADD,      //flag_res = flag_op1 + flag_op2 (+ carry)
+    FLAGS_SUB,      //flag_res = flag_op1 - flag_op2 (- borrow)
+    FLAGS_LOGIC,    //XOR/OR result, carry and aux carry clear
+    FLAGS_AND,      //flag_res = flag_op1 & flag_op2, carry clear
+    FLAGS_INC,      //INR result, carry untouched
+    FLAGS_DEC,      //DCR result, carry untouched
+};
+
+//why a core stopped for the debugger, in State8080.trap
+enum { TRAP_NONE, TRAP_BREAK, TRAP_READ, TRAP_WRITE };
+
+/* The I/O port bus: a handler and context for each port, called
+   straight through the table by IN and OUT. Unmapped ports read 0 and
+   ignore writes. */
+typedef uint8_t (*PortIn)(void *ctx, uint8_t port);
+typedef void (*PortOut)(void *ctx, uint8_t port, uint8_t value);
+
+typedef struct PortBus{
+    PortIn      in[256];
+    PortOut     out[256];
+    void        *in_ctx[256];
+    void        *out_ctx[256];
+}PortBus;
+
+//the invaders board's ports (see MachineAttach), kept per machine
+typedef struct MachineIO{
+    uint8_t     in[3];          //input latches read by IN 0..2
+    uint8_t     shift0;         //shift register, older byte
+    uint8_t     shift1;         //shift register, newer byte
+    uint8_t     shift_offset;
+}MachineIO;
+
+typedef struct State8080{
+    uint8_t     a;
+    uint8_t     b;
+    uint8_t     c;
+    uint8_t     d;
+    uint8_t     e;
+    uint8_t     h;
+    uint8_t     l;
+    uint16_t     sp;
+    uint16_t     pc;
+    uint8_t     *memory;
+    uint8_t     memory_mapped;  //memory is an mmap of a RomImage
+    struct  ConditionCodes   cc;
+    //ALU ops only note their operands and result here; the flags are
+    //worked out when something reads them (see SyncFlags)
+    uint16_t    flag_res;
+    uint8_t     flag_op1;
+    uint8_t     flag_op2;
+    uint8_t     flag_kind;
+    uint8_t     int_enable;
+    uint8_t     int_pending;    //an interrupt is waiting to be accepted
+    uint8_t     int_rst;        //the RST it vectors to
+    uint8_t     halted;         //HLT ran, only an interrupt resumes
+    uint8_t     stop;           //a core should return after this instruction
+    uint64_t    ei_done;        //cycle count just after the last EI
+    uint64_t    cycles;     //clock cycles executed since reset
+    uint64_t    instructions;   //instructions executed since reset
+    MachineIO   io;
+    PortBus     bus;
+    struct Trace8080 *trace;    //NULL unless tracing is switched on
+    struct Jit8080 *jit;        //NULL unless block translation is on
+    Predecode8080 *decoded;     //NULL unless the predecode cache is on
+    struct Replay8080 *replay;  //NULL unless recording or playing back
+    struct Profile8080 *profile;    //NULL unless profiling
+    struct Gdb8080 *gdb;        //NULL unless a debugger is attached
+    uint8_t     *breakpoints;   //bit per address, NULL unless one was set
+    uint8_t     trap;           //TRAP_*, a breakpoint or watchpoint was hit
+    uint8_t     page_flags[256];    //per 256-byte page, PAGE_*
+    uint32_t    line_dirty[64];     //bit per 32-byte line written, PAGE_DIRTY pages
+}State8080;
+
+int Emulate8080(State8080* state);
+int Run8080(State8080* state, int cycles);
+int Run8080Switch(State8080* state, int cycles);
+#if USE_COMPUTED_GOTO
+int Run8080Threaded(State8080* state, int cycles);
+int Run8080Predecoded(State8080* state, int cycles);
+Predecode8080* PredecodeCreate(void);
+void PredecodeFree(Predecode8080* cache);
+void PredecodeInvalidate(State8080* state, uint16_t adr);
+#endif
+State8080* Initialize8080(void);
+void Free8080(State8080* state);
+void ProtectRom(State8080* state, uint32_t start, uint32_t end);
+void Interrupt8080(State8080* state, uint8_t rst);
+void Accept8080(State8080* state);
+void PortReset(State8080* state);
+void PortMapIn(State8080* state, uint8_t port, PortIn fn, void *ctx);
+void PortMapOut(State8080* state, uint8_t port, PortOut fn, void *ctx);
+void MachineAttach(State8080* state);
+void MachineInterrupt(State8080* state, int half_frame_cycles);
+void ReadFile(State8080* state, char* filename, uint32_t offset);
+void SyncFlags(State8080* state);
+void WriteMemSlow(State8080* state, uint16_t adr, uint8_t value);
+
+#define ZSP_Z   0x01
+#define ZSP_S   0x02
+#define ZSP_P   0x04
+extern const uint8_t zsp8080[256];
+extern const uint8_t cycles8080[256];
+extern const uint8_t lengths8080[256];
+#define CONDITIONAL_TAKEN   6   //added to cycles8080 for a taken Ccc or Rcc
+
+/* All guest stores go through here so pages with something watching
+   them (translated code, ...) cost one extra test on the fast path. */
+static inline void WriteMem(State8080* state, uint16_t adr, uint8_t value)
+{
+    if (state->page_flags[adr >> 8])
+        WriteMemSlow(state, adr, value);
+    else
+        state->memory[adr] = value;
+}
+
+static inline uint8_t PortRead(State8080* state, uint8_t port)
+{
+    return state->bus.in[port](state->bus.in_ctx[port], port);
+}
+
+static inline void PortWrite(State8080* state, uint8_t port, uint8_t value)
+{
+    state->bus.out[port](state->bus.out_ctx[port], port, value);
+}
+
+/* Flag readers for conditional instructions. Z, S and P come straight
+   from a pending result; CY folds the pending op into cc first. */
+static inline int FlagZ(State8080* state)
+{
+    return state->flag_kind ? (state->flag_res & 0xff) == 0 : state->cc.z;
+}
+
+static inline int FlagS(State8080* state)
+{
+    return state->flag_kind ? (state->flag_res & 0x80) != 0 : state->cc.s;
+}
+
+static inline int FlagCY(State8080* state)
+{
+    if (state->flag_kind)
+        SyncFlags(state);
+    return state->cc.cy;
+}
+
+static inline int FlagP(State8080* state)
+{
+    return state->flag_kind ? (zsp8080[state->flag_res & 0xff] & ZSP_P) != 0 : state->cc.p;
+}
+
+#endif
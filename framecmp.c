@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <string.h>
+#include "framehash.h"
+
+/* Compares two frame-hash logs (emulator -H) and reports the first
+   frame where they differ.
+   Usage: framecmp golden.log run.log */
+
+#define CHUNK   65536
+
+//open a log for reading, positioned at frame 0
+static FILE* FrameLogOpen(const char *path)
+{
+    char magic[8];
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return NULL;
+    if (fread(magic, 8, 1, fp) != 1 || memcmp(magic, FRAMELOG_MAGIC, 8) != 0 ||
+        fgetc(fp) != FRAMELOG_VERSION)
+    {
+        fclose(fp);
+        return NULL;
+    }
+    return fp;
+}
+
+int main(int argc, char**argv)
+{
+    static uint8_t a[CHUNK * 4], b[CHUNK * 4];
+    if (argc != 3)
+    {
+        printf("usage: framecmp golden.log run.log\n");
+        return 2;
+    }
+
+    FILE *fa = FrameLogOpen(argv[1]);
+    FILE *fb = FrameLogOpen(argv[2]);
+    if (fa == NULL || fb == NULL)
+    {
+        printf("error: Couldn't read %s\n", fa == NULL ? argv[1] : argv[2]);
+        return 2;
+    }
+
+    //compare a chunk at a time and only look closer at a mismatch
+    unsigned long long frame = 0;
+    for (;;)
+    {
+        size_t na = fread(a, 4, CHUNK, fa);
+        size_t nb = fread(b, 4, CHUNK, fb);
+        size_t n = na < nb ? na : nb;
+
+        if (memcmp(a, b, n * 4) != 0)
+        {
+            size_t i = 0;
+            while (memcmp(a + i * 4, b + i * 4, 4) == 0)
+                i++;
+            uint32_t ha = a[i*4] | a[i*4+1] << 8 | a[i*4+2] << 16 | (uint32_t) a[i*4+3] << 24;
+            uint32_t hb = b[i*4] | b[i*4+1] << 8 | b[i*4+2] << 16 | (uint32_t) b[i*4+3] << 24;
+            printf("frame %llu differs: %08x vs %08x\n", frame + i, ha, hb);
+            return 1;
+        }
+        frame += n;
+        if (na != nb)
+        {
+            printf("%s ends at frame %llu\n", na < nb ? argv[1] : argv[2], frame);
+            return 1;
+        }
+        if (na < CHUNK)
+            break;
+    }
+    printf("%llu frames match\n", frame);
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef FRAMEHASH
+#define FRAMEHASH
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "emulator.h"
+#include "video.h"
+
+/* Per-frame hashes for golden-run regression. A frame's hash is the
+   CRC-32C of the CRCs of the 224 video lines followed by the registers;
+   line CRCs are kept between frames and only redone for lines marked
+   dirty (see VideoTrack), so hashing costs what changed. CRC-32C uses
+   the SSE4.2 crc32 instruction when the host has it.
+
+   A frame log is "8080HASH", a version byte and a little-endian u32
+   per frame, frame 0 first. */
+
+#define FRAMELOG_MAGIC      "8080HASH"
+#define FRAMELOG_VERSION    1
+
+typedef struct FrameHasher{
+    uint32_t    lines[VIDEO_WIDTH];     //CRC of each line of video RAM
+}FrameHasher;
+
+uint32_t Crc32c(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t FrameHash(FrameHasher *hasher, State8080* state, const uint32_t *lines);
+
+FILE* FrameLogCreate(const char *path);
+void FrameLogWrite(FILE *fp, uint32_t hash);
+
+#endif
@@ -0,0 +1,627 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "gdb.h"
+#include "jit.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL    0
+#endif
+
+#define GDB_SIGINT      2
+#define GDB_SIGTRAP     5
+
+static int Bit(const uint8_t *bits, uint16_t adr)
+{
+    return bits[adr >> 3] >> (adr & 7) & 1;
+}
+
+static void SetBit(uint8_t *bits, uint16_t adr, int on)
+{
+    if (on)
+        bits[adr >> 3] |= 1 << (adr & 7);
+    else
+        bits[adr >> 3] &= ~(1 << (adr & 7));
+}
+
+//a digits-only name is a TCP port on localhost, anything else a socket path
+static int Listen(const char *where)
+{
+    int fd, tcp = where[0] != 0 && strspn(where, "0123456789") == strlen(where);
+    if (tcp)
+    {
+        struct sockaddr_in sa;
+        int on = 1;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(atoi(where));
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, (struct sockaddr*) &sa, sizeof(sa)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        struct sockaddr_un sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+        if (strlen(where) >= sizeof(sa.sun_path))
+            return -1;
+        strcpy(sa.sun_path, where);
+        unlink(where);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (bind(fd, (struct sockaddr*) &sa, sizeof(sa)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    if (listen(fd, 1) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    printf("waiting for gdb on %s\n", where);
+    fflush(stdout);
+    int conn = accept(fd, NULL, NULL);
+    close(fd);
+    if (conn >= 0 && tcp)
+    {
+        int on = 1;
+        setsockopt(conn, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return conn;
+}
+
+static void Send(Gdb8080 *gdb, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(gdb->fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        data += n;
+        len -= n;
+    }
+}
+
+static void PutPacket(Gdb8080 *gdb, const char *data)
+{
+    static const char hex[] = "0123456789abcdef";
+    char out[GDB_PACKET_MAX + 8];
+    size_t len = strlen(data);
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++)
+        sum += (uint8_t) data[i];
+    out[0] = '$';
+    memcpy(out + 1, data, len);
+    out[len + 1] = '#';
+    out[len + 2] = hex[sum >> 4];
+    out[len + 3] = hex[sum & 15];
+    Send(gdb, out, len + 4);
+}
+
+static int GetChar(Gdb8080 *gdb)
+{
+    uint8_t c;
+    return recv(gdb->fd, &c, 1, 0) == 1 ? c : -1;
+}
+
+static int Hex(int c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    c = tolower(c);
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+//reads the next packet into gdb->packet, acking it; -1 if GDB went away
+static int GetPacket(Gdb8080 *gdb)
+{
+    for (;;)
+    {
+        int c;
+        do
+        {
+            if ((c = GetChar(gdb)) < 0)
+                return -1;
+        } while (c != '$');     //acks, and ^C while already stopped
+
+        int len = 0;
+        uint8_t sum = 0;
+        while ((c = GetChar(gdb)) >= 0 && c != '#')
+        {
+            if (len < GDB_PACKET_MAX)
+                gdb->packet[len++] = c;
+            sum += c;
+        }
+        int hi = GetChar(gdb), lo = GetChar(gdb);
+        if (c < 0 || hi < 0 || lo < 0)
+            return -1;
+        gdb->packet[len] = 0;
+        if (Hex(hi) * 16 + Hex(lo) == sum)
+        {
+            Send(gdb, "+", 1);
+            return len;
+        }
+        Send(gdb, "-", 1);
+    }
+}
+
+//GDB only sends ^C while the machine runs
+static int Interrupted(Gdb8080 *gdb)
+{
+    struct pollfd pfd = { gdb->fd, POLLIN, 0 };
+    while (poll(&pfd, 1, 0) > 0)
+    {
+        int c = GetChar(gdb);
+        if (c < 0 || c == 0x03)
+            return 1;
+    }
+    return 0;
+}
+
+static uint32_t ParseHex(const char **p)
+{
+    uint32_t v = 0;
+    while (Hex(**p) >= 0)
+        v = v << 4 | Hex(*(*p)++);
+    return v;
+}
+
+static void PutHex(char *out, const uint8_t *bytes, int n)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < n; i++)
+    {
+        out[i * 2] = hex[bytes[i] >> 4];
+        out[i * 2 + 1] = hex[bytes[i] & 15];
+    }
+    out[n * 2] = 0;
+}
+
+//the z80 register pairs GDB reads for an 8080: AF BC DE HL SP PC
+static uint16_t GetRegister(State8080* state, int n)
+{
+    SyncFlags(state);
+    uint8_t f = state->cc.s << 7 | state->cc.z << 6 | state->cc.ac << 4 |
+                state->cc.p << 2 | 0x02 | state->cc.cy;
+    switch (n)
+    {
+        case 0: return state->a << 8 | f;
+        case 1: return state->b << 8 | state->c;
+        case 2: return state->d << 8 | state->e;
+        case 3: return state->h << 8 | state->l;
+        case 4: return state->sp;
+        default: return state->pc;
+    }
+}
+
+static void SetRegister(State8080* state, int n, uint16_t v)
+{
+    switch (n)
+    {
+        case 0:
+            SyncFlags(state);
+            state->a = v >> 8;
+            state->cc.s = (v & 0x80) != 0;
+            state->cc.z = (v & 0x40) != 0;
+            state->cc.ac = (v & 0x10) != 0;
+            state->cc.p = (v & 0x04) != 0;
+            state->cc.cy = (v & 0x01) != 0;
+            state->flag_kind = FLAGS_NONE;
+            break;
+        case 1: state->b = v >> 8; state->c = v; break;
+        case 2: state->d = v >> 8; state->e = v; break;
+        case 3: state->h = v >> 8; state->l = v; break;
+        case 4: state->sp = v; break;
+        case 5: state->pc = v; break;
+    }
+}
+
+//GDB may patch ROM too, as long as the host page is writable
+static int Poke(State8080* state, uint16_t adr, uint8_t value)
+{
+    uint8_t flags = state->page_flags[adr >> 8];
+    if ((flags & PAGE_ROM) && state->memory_mapped)
+        return -1;
+    uint8_t trap = state->trap;
+    state->page_flags[adr >> 8] &= ~PAGE_ROM;
+    WriteMem(state, adr, value);
+    state->page_flags[adr >> 8] |= flags & PAGE_ROM;
+    state->trap = trap;
+    return 0;
+}
+
+static void SetBreak(State8080* state, uint16_t adr, int on)
+{
+    if (state->breakpoints == NULL)
+        state->breakpoints = calloc(0x2000, 1);
+    SetBit(state->breakpoints, adr, on);
+#if USE_COMPUTED_GOTO
+    //the next dispatch at adr decodes it again and sees the bitmap
+    if (state->decoded)
+        state->decoded->entries[adr].handler = state->decoded->miss;
+#endif
+}
+
+//GDB can set overlapping watchpoints and clears them one at a time, so
+//the bitmaps are rebuilt from the list rather than edited in place
+static int SetWatch(State8080* state, int type, uint16_t adr, uint32_t len, int on)
+{
+    Gdb8080 *gdb = state->gdb;
+    int i = 0;
+    while (i < gdb->watches && (gdb->watch[i].type != type ||
+                                gdb->watch[i].adr != adr || gdb->watch[i].len != len))
+        i++;
+    if (on)
+    {
+        if (gdb->watches == GDB_WATCH_MAX)
+            return -1;
+        gdb->watch[gdb->watches++] = (GdbWatch) { type, adr, len };
+    }
+    else if (i < gdb->watches)
+        gdb->watch[i] = gdb->watch[--gdb->watches];
+    else
+        return 0;
+
+    memset(gdb->watch_read, 0, sizeof(gdb->watch_read));
+    memset(gdb->watch_write, 0, sizeof(gdb->watch_write));
+    memset(gdb->watch_access, 0, sizeof(gdb->watch_access));
+    for (int w = 0; w < gdb->watches; w++)
+        for (uint32_t k = 0; k < gdb->watch[w].len && k < 0x10000; k++)
+        {
+            uint16_t a = gdb->watch[w].adr + k;
+            if (gdb->watch[w].type == 2 || gdb->watch[w].type == 4)
+                SetBit(gdb->watch_write, a, 1);
+            if (gdb->watch[w].type == 3 || gdb->watch[w].type == 4)
+                SetBit(gdb->watch_read, a, 1);
+            if (gdb->watch[w].type == 4)
+                SetBit(gdb->watch_access, a, 1);
+        }
+    for (int page = 0; page < 256; page++)
+    {
+        int watched = 0;
+        for (int k = 0; k < 32; k++)
+            watched |= gdb->watch_write[page * 32 + k];
+        if (watched)
+            state->page_flags[page] |= PAGE_WATCH;
+        else
+            state->page_flags[page] &= ~PAGE_WATCH;
+    }
+    return 0;
+}
+
+//called from WriteMemSlow for stores into a page with a write watchpoint
+void GdbWatchWrite(State8080* state, uint16_t adr)
+{
+    Gdb8080 *gdb = state->gdb;
+    if (gdb && Bit(gdb->watch_write, adr) && state->trap == TRAP_NONE)
+    {
+        state->trap = TRAP_WRITE;
+        gdb->watch_adr = adr;
+    }
+}
+
+//the bytes the instruction at pc loads, stack pops aside
+static int Loads(State8080* state, uint16_t *adr)
+{
+    uint8_t *op = &state->memory[state->pc];
+    uint16_t hl = state->h << 8 | state->l;
+    uint16_t imm = state->memory[(uint16_t) (state->pc + 1)] |
+                   state->memory[(uint16_t) (state->pc + 2)] << 8;
+    switch (op[0])
+    {
+        case 0x0a: adr[0] = state->b << 8 | state->c; return 1;    //LDAX B
+        case 0x1a: adr[0] = state->d << 8 | state->e; return 1;    //LDAX D
+        case 0x3a: adr[0] = imm; return 1;                          //LDA
+        case 0x2a: adr[0] = imm; adr[1] = imm + 1; return 2;        //LHLD
+        case 0xe3: adr[0] = state->sp; adr[1] = state->sp + 1; return 2;   //XTHL
+        case 0x34: case 0x35: adr[0] = hl; return 1;                //INR M, DCR M
+    }
+    if (((op[0] & 0xc7) == 0x46 && op[0] != 0x76) ||              //MOV r,M
+        (op[0] >= 0x80 && op[0] < 0xc0 && (op[0] & 7) == 6))       //ALU M
+    {
+        adr[0] = hl;
+        return 1;
+    }
+    return 0;
+}
+
+//one instruction, checking its loads against the read watchpoints
+static void Step(State8080* state)
+{
+    Gdb8080 *gdb = state->gdb;
+    uint16_t adr[2];
+    int n = 0;
+    uint8_t op = state->memory[state->pc];
+    uint16_t sp = state->sp;
+
+    if (gdb->watches)
+        n = Loads(state, adr);
+    Emulate8080(state);
+    if (!gdb->watches)
+        return;
+    //POP, RET and a taken Rcc read the two bytes sp moved past
+    if (((op & 0xcf) == 0xc1 || op == 0xc9 || op == 0xd9 || (op & 0xc7) == 0xc0) &&
+        state->sp == (uint16_t) (sp + 2))
+    {
+        adr[n++] = sp;
+        adr[n++] = sp + 1;
+    }
+    for (int i = 0; i < n && state->trap == TRAP_NONE; i++)
+        if (Bit(gdb->watch_read, adr[i]))
+        {
+            state->trap = TRAP_READ;
+            gdb->watch_adr = adr[i];
+        }
+}
+
+static void StopReply(State8080* state, char *out)
+{
+    Gdb8080 *gdb = state->gdb;
+    if (state->trap == TRAP_READ || state->trap == TRAP_WRITE)
+    {
+        const char *kind = Bit(gdb->watch_access, gdb->watch_adr) ? "awatch" :
+                           state->trap == TRAP_READ ? "rwatch" : "watch";
+        sprintf(out, "T%02x%s:%04x;", gdb->signal, kind, gdb->watch_adr);
+    }
+    else
+        sprintf(out, "S%02x", gdb->signal);
+}
+
+static void Detach(State8080* state)
+{
+    Gdb8080 *gdb = state->gdb;
+    if (state->breakpoints)
+    {
+        for (uint32_t adr = 0; adr < 0x10000; adr++)
+            if (Bit(state->breakpoints, adr))
+                SetBreak(state, adr, 0);
+        free(state->breakpoints);
+        state->breakpoints = NULL;
+    }
+    for (int page = 0; page < 256; page++)
+        state->page_flags[page] &= ~PAGE_WATCH;
+    state->trap = TRAP_NONE;
+    state->gdb = NULL;
+    GdbFree(gdb);
+}
+
+/* Answers GDB's packets until it resumes the machine (returns) or goes
+   away (detaches and returns). */
+static void Serve(State8080* state)
+{
+    Gdb8080 *gdb = state->gdb;
+    char reply[GDB_PACKET_MAX + 1];
+
+    for (;;)
+    {
+        if (GetPacket(gdb) < 0)
+        {
+            Detach(state);
+            return;
+        }
+        const char *p = gdb->packet + 1;
+        uint32_t adr, len, v;
+        reply[0] = 0;
+
+        switch (gdb->packet[0])
+        {
+            case '?':
+                StopReply(state, reply);
+                break;
+            case 'g':
+                for (int n = 0; n < 6; n++)
+                {
+                    uint16_t r = GetRegister(state, n);
+                    uint8_t bytes[2] = { r & 0xff, r >> 8 };
+                    PutHex(reply + n * 4, bytes, 2);
+                }
+                break;
+            case 'G':
+                for (int n = 0; n < 6 && strlen(p) >= 4; n++, p += 4)
+                    SetRegister(state, n, (Hex(p[0]) << 4 | Hex(p[1])) |
+                                          (Hex(p[2]) << 4 | Hex(p[3])) << 8);
+                strcpy(reply, "OK");
+                break;
+            case 'p':
+                v = ParseHex(&p);
+                if (v < 6)
+                {
+                    uint16_t r = GetRegister(state, v);
+                    uint8_t bytes[2] = { r & 0xff, r >> 8 };
+                    PutHex(reply, bytes, 2);
+                }
+                else
+                    strcpy(reply, "xxxx");  //z80 registers an 8080 lacks
+                break;
+            case 'P':
+                v = ParseHex(&p);
+                if (*p++ == '=' && v < 6 && strlen(p) >= 4)
+                {
+                    SetRegister(state, v, (Hex(p[0]) << 4 | Hex(p[1])) |
+                                          (Hex(p[2]) << 4 | Hex(p[3])) << 8);
+                    strcpy(reply, "OK");
+                }
+                else
+                    strcpy(reply, v < 6 ? "E01" : "OK");
+                break;
+            case 'm':
+                adr = ParseHex(&p);
+                p++;
+                len = ParseHex(&p);
+                if (len > GDB_PACKET_MAX / 2)
+                    len = GDB_PACKET_MAX / 2;
+                for (uint32_t i = 0; i < len; i++)
+                    PutHex(reply + i * 2, &state->memory[(uint16_t) (adr + i)], 1);
+                break;
+            case 'M':
+                adr = ParseHex(&p);
+                p++;
+                len = ParseHex(&p);
+                strcpy(reply, "OK");
+                if (*p++ != ':' || strlen(p) < len * 2)
+                    strcpy(reply, "E01");
+                else
+                    for (uint32_t i = 0; i < len; i++, p += 2)
+                        if (Poke(state, adr + i, Hex(p[0]) << 4 | Hex(p[1])) != 0)
+                            strcpy(reply, "E02");
+                break;
+            case 'c':
+            case 's':
+                if (*p)
+                    state->pc = ParseHex(&p);
+                state->trap = TRAP_NONE;
+                gdb->step = gdb->packet[0] == 's';
+                //continuing from a breakpoint runs its instruction first
+                gdb->over = !gdb->step && state->breakpoints &&
+                            Bit(state->breakpoints, state->pc);
+                return;
+            case 'Z':
+            case 'z':
+            {
+                int type = Hex(*p++), on = gdb->packet[0] == 'Z';
+                p++;
+                adr = ParseHex(&p);
+                p++;
+                len = ParseHex(&p);
+                if (type == 0 || type == 1)
+                    SetBreak(state, adr, on);
+                else if (type >= 2 && type <= 4)
+                {
+                    if (SetWatch(state, type, adr, len ? len : 1, on) != 0)
+                    {
+                        strcpy(reply, "E01");
+                        break;
+                    }
+                }
+                else
+                    break;
+                strcpy(reply, "OK");
+                break;
+            }
+            case 'k':
+                printf("gdb killed the machine\n");
+                exit(0);
+            case 'D':
+                PutPacket(gdb, "OK");
+                Detach(state);
+                return;
+            case 'H':
+                strcpy(reply, "OK");
+                break;
+            case 'q':
+                if (strncmp(gdb->packet, "qSupported", 10) == 0)
+                    sprintf(reply, "PacketSize=%x", GDB_PACKET_MAX);
+                else if (strcmp(gdb->packet, "qAttached") == 0)
+                    strcpy(reply, "1");
+                else if (strcmp(gdb->packet, "qC") == 0)
+                    strcpy(reply, "QC1");
+                break;
+        }
+        PutPacket(gdb, reply);
+    }
+}
+
+//reports the stop to GDB and waits for it to resume the machine
+static void Stopped(State8080* state, int signal)
+{
+    char reply[64];
+    state->gdb->signal = signal;
+    StopReply(state, reply);
+    PutPacket(state->gdb, reply);
+    Serve(state);
+}
+
+int GdbAttach(State8080* state, const char *where)
+{
+    int fd = Listen(where);
+    if (fd < 0)
+        return -1;
+    Gdb8080 *gdb = calloc(1, sizeof(Gdb8080));
+    gdb->fd = fd;
+    gdb->signal = GDB_SIGTRAP;
+    state->gdb = gdb;
+#if USE_COMPUTED_GOTO
+    if (state->decoded == NULL)
+        state->decoded = PredecodeCreate();
+#endif
+    //GDB starts by asking why the machine stopped
+    Serve(state);
+    return 0;
+}
+
+void GdbFree(Gdb8080 *gdb)
+{
+    if (gdb == NULL)
+        return;
+    close(gdb->fd);
+    free(gdb);
+}
+
+/* The core RunCore uses while GDB is attached: the predecoded core when
+   only breakpoints are set, one instruction at a time when watchpoints
+   are. Returns early, like the other cores, after GDB has seen a stop. */
+void GdbRun(State8080* state, int cycles)
+{
+    Gdb8080 *gdb = state->gdb;
+    uint64_t end = state->cycles + cycles;
+
+    //Accept8080 pushing onto a watched stack traps before we get here
+    if (state->trap != TRAP_NONE)
+    {
+        Stopped(state, GDB_SIGTRAP);
+        return;
+    }
+    if (Interrupted(gdb))
+    {
+        Stopped(state, GDB_SIGINT);
+        return;
+    }
+    if (gdb->step || gdb->over)
+    {
+        int step = gdb->step;
+        gdb->step = gdb->over = 0;
+        Step(state);
+        if (step || state->trap != TRAP_NONE)
+        {
+            Stopped(state, GDB_SIGTRAP);
+            return;
+        }
+    }
+
+#if USE_COMPUTED_GOTO
+    if (!gdb->watches)
+        Run8080Predecoded(state, (int) (end - state->cycles));
+    else
+#endif
+    while (state->cycles < end && !state->stop && state->trap == TRAP_NONE)
+    {
+        if (state->breakpoints && Bit(state->breakpoints, state->pc))
+        {
+            state->trap = TRAP_BREAK;
+            break;
+        }
+        Step(state);
+    }
+    if (state->trap != TRAP_NONE)
+        Stopped(state, GDB_SIGTRAP);
+}
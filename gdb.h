@@ -0,0 +1,54 @@
+#ifndef GDB
+#define GDB
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* A GDB remote serial protocol stub on a local TCP port or Unix socket.
+   GDB has no 8080 target of its own; its z80 one (set architecture z80)
+   reads the first six register pairs, AF BC DE HL SP PC, which is what
+   the stub sends. It supports register and memory reads and writes,
+   step, continue, ^C, breakpoints (Z0/Z1) and write, read and access
+   watchpoints (Z2/Z3/Z4).
+
+   Breakpoints are bits in State8080.breakpoints. The predecode cache
+   dispatches a pc whose bit is set to a label that stops the core
+   before the instruction, and the bitmap is only looked at when a pc is
+   decoded, so breakpoints cost nothing while they aren't hit. Writes to
+   watched addresses are caught in WriteMemSlow through PAGE_WATCH. Read
+   watchpoints need every load checked, so while any watchpoint is set
+   the stub steps instructions one at a time itself; without computed
+   goto it always does. The JIT is bypassed while the stub is attached.
+
+   While GDB has the machine stopped, GdbRun blocks in the conversation;
+   the emulated clock stands still and picks up where it left off. */
+
+#define GDB_PACKET_MAX  4096
+#define GDB_WATCH_MAX   32
+
+typedef struct GdbWatch{
+    uint8_t     type;                   //2 write, 3 read, 4 access
+    uint16_t    adr;
+    uint32_t    len;
+}GdbWatch;
+
+typedef struct Gdb8080{
+    int         fd;
+    GdbWatch    watch[GDB_WATCH_MAX];   //as GDB set them, overlaps and all
+    int         watches;                //entries in watch
+    uint8_t     watch_read[0x2000];     //bit per address, rebuilt from watch
+    uint8_t     watch_write[0x2000];
+    uint8_t     watch_access[0x2000];   //set by Z4, for the stop reply
+    uint8_t     step;                   //run one instruction, then stop
+    uint8_t     over;                   //pc is on a breakpoint continued from
+    uint8_t     signal;                 //for the stop reply
+    uint16_t    watch_adr;              //the watched address that was hit
+    char        packet[GDB_PACKET_MAX + 1];
+}Gdb8080;
+
+int GdbAttach(State8080* state, const char *where);
+void GdbFree(Gdb8080 *gdb);
+void GdbRun(State8080* state, int cycles);
+void GdbWatchWrite(State8080* state, uint16_t adr);
+
+#endif
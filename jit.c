@@ -0,0 +1,443 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "jit.h"
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__) || defined(__unix__))
+#include <sys/mman.h>
+
+#define JIT_HOT             8
+#define JIT_CACHE_SIZE      (4 << 20)
+#define BLOCK_MAX_INSNS     32
+#define BLOCK_MAX_BYTES     (BLOCK_MAX_INSNS * 64 + 64)
+
+#define EAX     0
+#define ECX     1
+
+typedef struct Emitter{
+    uint8_t     *p;
+}Emitter;
+
+//State8080 offsets by the 8080 register field encoding; 6 is M
+static const size_t regoff[8] = {
+    offsetof(State8080, b), offsetof(State8080, c),
+    offsetof(State8080, d), offsetof(State8080, e),
+    offsetof(State8080, h), offsetof(State8080, l),
+    0, offsetof(State8080, a),
+};
+
+static void Put8(Emitter *e, uint8_t v)
+{
+    *e->p++ = v;
+}
+
+static void Put16(Emitter *e, uint16_t v)
+{
+    memcpy(e->p, &v, 2);
+    e->p += 2;
+}
+
+static void Put32(Emitter *e, uint32_t v)
+{
+    memcpy(e->p, &v, 4);
+    e->p += 4;
+}
+
+static void Put64(Emitter *e, uint64_t v)
+{
+    memcpy(e->p, &v, 8);
+    e->p += 8;
+}
+
+//ModRM + disp32 for a [rbx+off] operand; rbx holds the State8080 pointer
+static void Mem(Emitter *e, int reg, size_t off)
+{
+    Put8(e, 0x80 | (reg << 3) | 3);
+    Put32(e, (uint32_t) off);
+}
+
+//movzx r32, byte [rbx+off]
+static void LoadByte(Emitter *e, int reg, size_t off)
+{
+    Put8(e, 0x0f); Put8(e, 0xb6);
+    Mem(e, reg, off);
+}
+
+//mov [rbx+off], r8
+static void StoreByte(Emitter *e, int reg, size_t off)
+{
+    Put8(e, 0x88);
+    Mem(e, reg, off);
+}
+
+//mov [rbx+off], r16
+static void StoreWord(Emitter *e, int reg, size_t off)
+{
+    Put8(e, 0x66); Put8(e, 0x89);
+    Mem(e, reg, off);
+}
+
+static void StoreImm8(Emitter *e, size_t off, uint8_t v)
+{
+    Put8(e, 0xc6);
+    Mem(e, 0, off);
+    Put8(e, v);
+}
+
+static void StoreImm16(Emitter *e, size_t off, uint16_t v)
+{
+    Put8(e, 0x66); Put8(e, 0xc7);
+    Mem(e, 0, off);
+    Put16(e, v);
+}
+
+//add qword [rbx+off], n
+static void AddCounter(Emitter *e, size_t off, int n)
+{
+    if (n == 0)
+        return;
+    Put8(e, 0x48); Put8(e, 0x81);
+    Mem(e, 0, off);
+    Put32(e, n);
+}
+
+//account for the directly translated instructions since the last flush
+static void AddCycles(Emitter *e, int cycles, int insns)
+{
+    AddCounter(e, offsetof(State8080, cycles), cycles);
+    AddCounter(e, offsetof(State8080, instructions), insns);
+}
+
+static void Leave(Emitter *e)
+{
+    Put8(e, 0x5b);      //pop rbx
+    Put8(e, 0xc3);      //ret
+}
+
+//call Emulate8080(state) for the instruction at pc
+static void CallInterpreter(Emitter *e, uint16_t pc)
+{
+    StoreImm16(e, offsetof(State8080, pc), pc);
+    Put8(e, 0x48); Put8(e, 0x89); Put8(e, 0xdf);        //mov rdi, rbx
+    Put8(e, 0x48); Put8(e, 0xb8);                       //mov rax, imm64
+    Put64(e, (uint64_t) (uintptr_t) Emulate8080);
+    Put8(e, 0xff); Put8(e, 0xd0);                       //call rax
+}
+
+//leave the block if the interpreted instruction overwrote translated code
+static void CheckDirty(Emitter *e, Jit8080 *jit)
+{
+    Put8(e, 0x48); Put8(e, 0xb8);                       //mov rax, &jit->dirty
+    Put64(e, (uint64_t) (uintptr_t) &jit->dirty);
+    Put8(e, 0x80); Put8(e, 0x38); Put8(e, 0x00);        //cmp byte [rax], 0
+    Put8(e, 0x74); Put8(e, 0x02);                       //je +2
+    Leave(e);
+}
+
+//instructions after which the next pc is not simply pc + length
+static int EndsBlock(uint8_t op)
+{
+    switch (op & 0xc7)
+    {
+        case 0xc0:      //Rcc
+        case 0xc2:      //Jcc
+        case 0xc4:      //Ccc
+        case 0xc7:      //RST
+            return 1;
+    }
+    switch (op)
+    {
+        case 0xc3: case 0xcb:               //JMP
+        case 0xc9: case 0xd9:               //RET
+        case 0xcd: case 0xdd: case 0xed: case 0xfd: //CALL
+        case 0xe9:                          //PCHL
+        case 0x76:                          //HLT
+        case 0xf3: case 0xfb:               //DI, EI
+            return 1;
+    }
+    return 0;
+}
+
+//A op= r or immediate, recorded for the lazy flags like ArithFlags does
+static void EmitAlu(Emitter *e, int group, int src, int imm, uint8_t value)
+{
+    static const uint8_t hostop[8] = { 0x01, 0, 0x29, 0, 0x21, 0x31, 0x09, 0x29 };
+    static const uint8_t kinds[8] = { FLAGS_ADD, 0, FLAGS_SUB, 0, FLAGS_AND, FLAGS_LOGIC, FLAGS_LOGIC, FLAGS_SUB };
+
+    LoadByte(e, EAX, offsetof(State8080, a));
+    if (imm)
+    {
+        Put8(e, 0xb9);                                  //mov ecx, imm32
+        Put32(e, value);
+    }
+    else
+        LoadByte(e, ECX, regoff[src]);
+    StoreByte(e, EAX, offsetof(State8080, flag_op1));
+    StoreByte(e, ECX, offsetof(State8080, flag_op2));
+    Put8(e, hostop[group]); Put8(e, 0xc8);              //op eax, ecx
+    StoreWord(e, EAX, offsetof(State8080, flag_res));
+    if (group != 7)                                     //CMP keeps A
+        StoreByte(e, EAX, offsetof(State8080, a));
+    StoreImm8(e, offsetof(State8080, flag_kind), kinds[group]);
+}
+
+/* Emits host code for one guest instruction if it is in the directly
+   translated set. Returns 0 when it must go through the interpreter. */
+static int EmitDirect(Emitter *e, uint8_t *op)
+{
+    uint8_t code = op[0];
+
+    if (code == 0x00)
+        return 1;
+    if (code >= 0x40 && code < 0x80)                    //MOV r,r
+    {
+        int dst = (code >> 3) & 7, src = code & 7;
+        if (dst == 6 || src == 6)
+            return 0;
+        LoadByte(e, EAX, regoff[src]);
+        StoreByte(e, EAX, regoff[dst]);
+        return 1;
+    }
+    if ((code & 0xc7) == 0x06 && code != 0x36)          //MVI r
+    {
+        StoreImm8(e, regoff[(code >> 3) & 7], op[1]);
+        return 1;
+    }
+    if (code >= 0x80 && code < 0xc0)                    //ALU A,r
+    {
+        int group = (code >> 3) & 7, src = code & 7;
+        if (src == 6 || group == 1 || group == 3)       //M, ADC, SBB
+            return 0;
+        EmitAlu(e, group, src, 0, 0);
+        return 1;
+    }
+    switch (code)
+    {
+        case 0xc6: EmitAlu(e, 0, 0, 1, op[1]); return 1;    //ADI
+        case 0xd6: EmitAlu(e, 2, 0, 1, op[1]); return 1;    //SUI
+        case 0xe6: EmitAlu(e, 4, 0, 1, op[1]); return 1;    //ANI
+        case 0xee: EmitAlu(e, 5, 0, 1, op[1]); return 1;    //XRI
+        case 0xf6: EmitAlu(e, 6, 0, 1, op[1]); return 1;    //ORI
+        case 0xfe: EmitAlu(e, 7, 0, 1, op[1]); return 1;    //CPI
+        case 0x01: case 0x11: case 0x21:                    //LXI rp
+        {
+            int hi = (code >> 3) & 6;
+            StoreImm8(e, regoff[hi + 1], op[1]);
+            StoreImm8(e, regoff[hi], op[2]);
+            return 1;
+        }
+        case 0x31:                                          //LXI SP
+            StoreImm16(e, offsetof(State8080, sp), (op[2] << 8) | op[1]);
+            return 1;
+        case 0x03: case 0x13: case 0x23:                    //INX rp
+        case 0x0b: case 0x1b: case 0x2b:                    //DCX rp
+        {
+            int hi = (code >> 3) & 6;
+            int inc = (code & 0x08) == 0;
+            Put8(e, 0x80); Mem(e, inc ? 0 : 5, regoff[hi + 1]); Put8(e, 1);  //add/sub lo, 1
+            Put8(e, 0x80); Mem(e, inc ? 2 : 3, regoff[hi]); Put8(e, 0);      //adc/sbb hi, 0
+            return 1;
+        }
+        case 0x33: case 0x3b:                               //INX SP, DCX SP
+            Put8(e, 0x66); Put8(e, 0x83);
+            Mem(e, code == 0x33 ? 0 : 5, offsetof(State8080, sp));
+            Put8(e, 1);
+            return 1;
+    }
+    return 0;
+}
+
+static void Flush(Jit8080 *jit, State8080* state)
+{
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->heat, 0, sizeof(jit->heat));
+    memset(jit->page_blocks, 0, sizeof(jit->page_blocks));
+    for (int i = 0; i < 256; i++)
+        state->page_flags[i] &= ~PAGE_CODE;
+    jit->used = 0;
+}
+
+static JitBlock Translate(Jit8080 *jit, State8080* state, uint16_t start)
+{
+    if (jit->size - jit->used < BLOCK_MAX_BYTES)
+        Flush(jit, state);
+
+    Emitter e = { jit->code + jit->used };
+    uint8_t *entry = e.p;
+    uint32_t pc = start;
+    int pending = 0, pending_insns = 0, direct = 0, total = 0;
+
+    Put8(&e, 0x53);                                     //push rbx
+    Put8(&e, 0x48); Put8(&e, 0x89); Put8(&e, 0xfb);     //mov rbx, rdi
+
+    for (int n = 0; n < BLOCK_MAX_INSNS && pc < 0xfffd; n++)
+    {
+        uint8_t *op = &state->memory[pc];
+        total += cycles8080[op[0]];
+        if (op[0] == 0xc3)                              //JMP: just retarget
+        {
+            AddCycles(&e, pending + cycles8080[0xc3], pending_insns + 1);
+            StoreImm16(&e, offsetof(State8080, pc), (op[2] << 8) | op[1]);
+            Leave(&e);
+            pc += 3;
+            pending = -1;
+            break;
+        }
+        if (EmitDirect(&e, op))
+        {
+            pending += cycles8080[op[0]];
+            pending_insns++;
+            direct++;
+            pc += lengths8080[op[0]];
+            continue;
+        }
+        AddCycles(&e, pending, pending_insns);
+        pending = pending_insns = 0;
+        CallInterpreter(&e, pc);
+        if (EndsBlock(op[0]))
+        {
+            Leave(&e);
+            pc += lengths8080[op[0]];
+            pending = -1;
+            break;
+        }
+        CheckDirty(&e, jit);
+        pc += lengths8080[op[0]];
+    }
+    if (pending >= 0)                                   //fell off the end
+    {
+        AddCycles(&e, pending, pending_insns);
+        StoreImm16(&e, offsetof(State8080, pc), pc);
+        Leave(&e);
+    }
+
+    //nothing gained over interpreting it
+    if (direct == 0)
+        return NULL;
+
+    jit->used += e.p - entry;
+    jit->blocks[start] = (JitBlock) (void *) entry;
+    jit->ends[start] = pc - 1;
+    jit->costs[start] = total;
+    for (uint32_t page = start >> 8; page <= ((pc - 1) >> 8); page++)
+    {
+        jit->page_blocks[page]++;
+        state->page_flags[page] |= PAGE_CODE;
+    }
+    return jit->blocks[start];
+}
+
+static void Drop(Jit8080 *jit, State8080* state, uint16_t start)
+{
+    for (uint32_t page = start >> 8; page <= (jit->ends[start] >> 8u); page++)
+        if (--jit->page_blocks[page] == 0)
+            state->page_flags[page] &= ~PAGE_CODE;
+    jit->blocks[start] = NULL;
+    jit->heat[start] = 0;
+}
+
+Jit8080* JitCreate(void)
+{
+    void *code = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return NULL;
+
+    Jit8080 *jit = calloc(1, sizeof(Jit8080));
+    jit->code = code;
+    jit->size = JIT_CACHE_SIZE;
+    return jit;
+}
+
+void JitFree(Jit8080 *jit)
+{
+    if (jit == NULL)
+        return;
+    munmap(jit->code, jit->size);
+    free(jit);
+}
+
+/* Called from WriteMemSlow for stores into a page holding translated
+   code. Blocks are under 256 bytes, so only blocks starting in this
+   page or the one before can cover adr. */
+void JitInvalidate(State8080* state, uint16_t adr)
+{
+    Jit8080 *jit = state->jit;
+    uint32_t page = adr >> 8;
+    uint32_t lo = page ? (page - 1) << 8 : 0;
+
+    for (uint32_t pc = lo; pc <= adr; pc++)
+    {
+        if (jit->blocks[pc] && adr <= jit->ends[pc])
+        {
+            Drop(jit, state, pc);
+            jit->dirty = 1;
+        }
+    }
+}
+
+/* Translates the blocks starting at starts up front, as listed in a
+   block map from static analysis, rather than waiting for them to get
+   hot. Starts that gain nothing from translating are not tried again. */
+void JitPreload(State8080* state, const uint16_t *starts, int count)
+{
+    Jit8080 *jit = state->jit;
+    for (int i = 0; i < count; i++)
+        if (jit->blocks[starts[i]] == NULL && Translate(jit, state, starts[i]) == NULL)
+            jit->heat[starts[i]] = 0xff;
+}
+
+int JitRun(State8080* state, int cycles)
+{
+    Jit8080 *jit = state->jit;
+    uint64_t end = state->cycles + cycles;
+
+    while (state->cycles < end && !state->stop)
+    {
+        uint16_t pc = state->pc;
+        JitBlock block = jit->blocks[pc];
+        if (block == NULL && jit->heat[pc] < 0xff && ++jit->heat[pc] == JIT_HOT)
+            block = Translate(jit, state, pc);
+        //a block runs to its end without looking at the budget, so one
+        //that might cross it is interpreted, stopping where the other
+        //cores do
+        if (block && state->cycles + jit->costs[pc] <= end)
+        {
+            jit->dirty = 0;
+            block(state);
+        }
+        else
+            Emulate8080(state);
+    }
+    return (int) (state->cycles - end);
+}
+
+#else
+
+Jit8080* JitCreate(void)
+{
+    return NULL;
+}
+
+void JitFree(Jit8080 *jit)
+{
+}
+
+int JitRun(State8080* state, int cycles)
+{
+    uint64_t end = state->cycles + cycles;
+    while (state->cycles < end && !state->stop)
+        Emulate8080(state);
+    return (int) (state->cycles - end);
+}
+
+void JitInvalidate(State8080* state, uint16_t adr)
+{
+}
+
+void JitPreload(State8080* state, const uint16_t *starts, int count)
+{
+}
+
+#endif
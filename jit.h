@@ -0,0 +1,32 @@
+#ifndef JIT
+#define JIT
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* Basic-block translator from 8080 to x86-64. Guest code that has been
+   interpreted JIT_HOT times is translated into the code cache; register
+   moves, immediates, 16-bit increments and most ALU ops become host
+   instructions, anything else is a call back into Emulate8080. */
+
+typedef void (*JitBlock)(State8080* state);
+
+typedef struct Jit8080{
+    uint8_t     *code;              //mmap'd code cache
+    uint32_t    size;
+    uint32_t    used;
+    uint8_t     dirty;              //a store hit translated code
+    JitBlock    blocks[0x10000];    //host entry for each guest pc, or NULL
+    uint16_t    ends[0x10000];      //last guest byte of the block at pc
+    uint16_t    costs[0x10000];     //cycles of the block at pc, branches not taken
+    uint8_t     heat[0x10000];      //times pc was interpreted
+    uint16_t    page_blocks[256];   //live blocks touching each page
+}Jit8080;
+
+Jit8080* JitCreate(void);
+void JitFree(Jit8080 *jit);
+int JitRun(State8080* state, int cycles);
+void JitInvalidate(State8080* state, uint16_t adr);
+void JitPreload(State8080* state, const uint16_t *starts, int count);
+
+#endif
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.h"
+#include "lockstep.h"
+
+/* Checks LockstepRun against Run8080 on random programs. Each group of
+   LOCKSTEP_LANES machines gets random code, heavy in conditional CALL
+   and RET, and random registers; lanes are paired on the same program
+   with different flags so they run together and split at the branches.
+   Every machine is run both ways for the same cycles and the registers,
+   cycle and instruction counts and memory must come out the same.
+   Usage: lockcheck [groups] [cycles] */
+
+#define CODE_SIZE   0x1000
+
+static uint32_t Random(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return *seed >> 8;
+}
+
+//Ccc, Rcc, CALL and RET; a quarter of the opcodes are drawn from these
+static const uint8_t branches[] = {
+    0xc4, 0xcc, 0xd4, 0xdc, 0xe4, 0xec, 0xf4, 0xfc, 0xcd,
+    0xc0, 0xc8, 0xd0, 0xd8, 0xe0, 0xe8, 0xf0, 0xf8, 0xc9,
+};
+
+static void RandomProgram(uint8_t *memory, uint32_t *seed)
+{
+    for (int adr = 0; adr < CODE_SIZE; adr++)
+    {
+        uint8_t op = Random(seed);
+        if (Random(seed) % 4 == 0)
+            op = branches[Random(seed) % sizeof(branches)];
+        memory[adr] = op;
+    }
+    //keep about half the call and jump targets in the code, below the stack
+    for (int adr = 0; adr + 2 < CODE_SIZE; adr += 3)
+        if (Random(seed) % 2)
+            memory[adr + 2] &= (CODE_SIZE - 1) >> 8;
+}
+
+static State8080* NewMachine(const uint8_t *program, uint32_t *seed, uint8_t flags)
+{
+    State8080 *state = Initialize8080();
+    memcpy(state->memory, program, CODE_SIZE);
+    state->a = Random(seed);
+    state->b = Random(seed);
+    state->c = Random(seed);
+    state->d = Random(seed);
+    state->e = Random(seed);
+    state->h = Random(seed) & ((CODE_SIZE - 1) >> 8);
+    state->l = Random(seed);
+    state->sp = 0x8000 + (Random(seed) & 0x3ffe);
+    state->pc = Random(seed) & (CODE_SIZE - 1);
+    state->cc.s = flags >> 7 & 1;
+    state->cc.z = flags >> 6 & 1;
+    state->cc.ac = flags >> 4 & 1;
+    state->cc.p = flags >> 2 & 1;
+    state->cc.cy = flags & 1;
+    state->flag_kind = FLAGS_NONE;
+    return state;
+}
+
+static State8080* Copy(const State8080 *from)
+{
+    State8080 *state = Initialize8080();
+    uint8_t *memory = state->memory;
+    *state = *from;
+    state->memory = memory;
+    memcpy(memory, from->memory, 0x10000);
+    return state;
+}
+
+static int Same(State8080 *a, State8080 *b)
+{
+    SyncFlags(a);
+    SyncFlags(b);
+    return a->a == b->a && a->b == b->b && a->c == b->c && a->d == b->d &&
+           a->e == b->e && a->h == b->h && a->l == b->l &&
+           a->sp == b->sp && a->pc == b->pc &&
+           a->cc.s == b->cc.s && a->cc.z == b->cc.z && a->cc.ac == b->cc.ac &&
+           a->cc.p == b->cc.p && a->cc.cy == b->cc.cy &&
+           a->int_enable == b->int_enable && a->halted == b->halted &&
+           a->cycles == b->cycles && a->instructions == b->instructions &&
+           memcmp(a->memory, b->memory, 0x10000) == 0;
+}
+
+int main(int argc, char**argv)
+{
+    int groups = argc > 1 ? atoi(argv[1]) : 30;
+    int cycles = argc > 2 ? atoi(argv[2]) : 100000;
+    uint32_t seed = 1;
+    uint8_t *program = malloc(CODE_SIZE);
+    int differ = 0, total = 0;
+
+    for (int g = 0; g < groups; g++)
+    {
+        State8080 *lanes[LOCKSTEP_LANES], *scalar[LOCKSTEP_LANES];
+        uint32_t pair = 0;
+        for (int k = 0; k < LOCKSTEP_LANES; k++)
+        {
+            if (k % 2 == 0)
+            {
+                RandomProgram(program, &seed);
+                pair = Random(&seed);
+            }
+            uint32_t regs = pair;
+            lanes[k] = NewMachine(program, &regs, k % 2 ? 0xff : 0x00);
+            scalar[k] = Copy(lanes[k]);
+        }
+
+        Lockstep8080 *ls = LockstepCreate(lanes, LOCKSTEP_LANES);
+        LockstepRun(ls, cycles);
+        LockstepFree(ls);
+        for (int k = 0; k < LOCKSTEP_LANES; k++)
+        {
+            Run8080(scalar[k], cycles);
+            if (!Same(lanes[k], scalar[k]))
+            {
+                if (differ < 10)
+                    printf("group %d lane %d: lockstep pc %04x cycles %llu, Run8080 pc %04x cycles %llu\n",
+                           g, k, lanes[k]->pc, (unsigned long long) lanes[k]->cycles,
+                           scalar[k]->pc, (unsigned long long) scalar[k]->cycles);
+                differ++;
+            }
+            total++;
+            Free8080(lanes[k]);
+            Free8080(scalar[k]);
+        }
+    }
+    printf("%d of %d machines differ\n", differ, total);
+    free(program);
+    return differ != 0;
+}
@@ -0,0 +1,540 @@
+#include <stdlib.h>
+#include <string.h>
+#include "lockstep.h"
+#if defined(__SSE2__) && LOCKSTEP_LANES == 16
+#include <emmintrin.h>
+#endif
+
+//flag bits in Lockstep8080.f
+#define FLAG_S      0x80
+#define FLAG_Z      0x40
+#define FLAG_AC     0x10
+#define FLAG_P      0x04
+#define FLAG_CY     0x01
+
+//what vector comparisons produce: all ones or all zeros per lane
+typedef int8_t Mask8 __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef int16_t Mask16 __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+typedef int32_t Mask32 __attribute__((vector_size(LOCKSTEP_LANES * 4)));
+
+#define HL  4       //Pair() index of HL; 0 is BC, 2 is DE
+
+#define Widen(x)        __builtin_convertvector(x, Lane16)
+#define Narrow(x)       __builtin_convertvector(x, Lane8)
+#define Widen16(m)      ((Lane16) __builtin_convertvector((Mask8) (m), Mask16))
+#define Splat16(x)      ((Lane16) {0} + (uint16_t) (x))
+
+//x in the lanes where m is set, y elsewhere
+#define Blend8(m, x, y)     (((x) & (m)) | ((y) & ~(m)))
+#define Blend16(m, x, y)    (((x) & (m)) | ((y) & ~(m)))
+
+//bit i set for every lane i of m that is all ones
+static inline unsigned Bits(Lane8 m)
+{
+#if defined(__SSE2__) && LOCKSTEP_LANES == 16
+    return _mm_movemask_epi8((__m128i) m);
+#else
+    unsigned bits = 0;
+    for (int i = 0; i < LOCKSTEP_LANES; i++)
+        bits |= (unsigned) (m[i] >> 7) << i;
+    return bits;
+#endif
+}
+
+//S, Z and P for each lane's result, plus bit 1 which always reads 1
+static inline Lane8 FlagsZSP(Lane8 x)
+{
+    Lane8 p = x ^ (x >> 4);
+    p ^= p >> 2;
+    p ^= p >> 1;
+    return (x & FLAG_S) | ((Lane8) (x == 0) & FLAG_Z) | ((~p & 1) << 2) | 0x02;
+}
+
+/* Vectors wider than 16 bytes never go in or out of a function by
+   value: without AVX, GCC warns that the ABI for that changed. */
+#define Pair(ls, hi)    ((Widen((ls)->r[hi]) << 8) | Widen((ls)->r[(hi) + 1]))
+
+static inline void SetPair(Lockstep8080* ls, int hi, const Lane16 *v, Lane8 m)
+{
+    ls->r[hi] = Blend8(m, Narrow(*v >> 8), ls->r[hi]);
+    ls->r[hi + 1] = Blend8(m, Narrow(*v), ls->r[hi + 1]);
+}
+
+//each lane's byte at adr in its own memory, for the lanes in bits
+static Lane8 Load8(Lockstep8080* ls, const Lane16 *adr, unsigned bits)
+{
+    Lane8 v = {0};
+    for (; bits; bits &= bits - 1)
+    {
+        int i = __builtin_ctz(bits);
+        v[i] = ls->machines[i]->memory[(*adr)[i]];
+    }
+    return v;
+}
+
+static void Store8(Lockstep8080* ls, const Lane16 *adr, Lane8 v, unsigned bits)
+{
+    for (; bits; bits &= bits - 1)
+    {
+        int i = __builtin_ctz(bits);
+        WriteMem(ls->machines[i], (*adr)[i], v[i]);
+    }
+}
+
+static void Load16(Lockstep8080* ls, const Lane16 *adr, Lane16 *v, unsigned bits)
+{
+    Lane16 hi = *adr + 1;
+    *v = Widen(Load8(ls, adr, bits)) | (Widen(Load8(ls, &hi, bits)) << 8);
+}
+
+static void Store16(Lockstep8080* ls, const Lane16 *adr, const Lane16 *v, unsigned bits)
+{
+    Lane16 hi = *adr + 1;
+    Store8(ls, adr, Narrow(*v), bits);
+    Store8(ls, &hi, Narrow(*v >> 8), bits);
+}
+
+static void Push(Lockstep8080* ls, const Lane16 *v, Lane8 m, unsigned bits)
+{
+    Lane16 sp = ls->sp - 2;
+    Store16(ls, &sp, v, bits);
+    ls->sp = Blend16(Widen16(m), sp, ls->sp);
+}
+
+static void Pop(Lockstep8080* ls, Lane16 *v, Lane8 m, unsigned bits)
+{
+    Load16(ls, &ls->sp, v, bits);
+    ls->sp = Blend16(Widen16(m), ls->sp + 2, ls->sp);
+}
+
+//lanes where condition cc (the opcode's bits 3..5) holds
+static Lane8 Condition(Lockstep8080* ls, int cc)
+{
+    static const uint8_t flag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+    Lane8 set = (Lane8) ((ls->f & flag[cc >> 1]) != 0);
+    return (cc & 1) ? set : ~set;
+}
+
+//ADD ADC SUB SBB ANA XRA ORA CMP, by the opcode's bits 3..5
+static void Alu(Lockstep8080* ls, int group, Lane8 v, Lane8 m)
+{
+    Lane8 a = ls->r[7];
+    Lane16 cy = {0};
+    Lane8 res, f;
+
+    if (group == 1 || group == 3)
+        cy = Widen(ls->f & FLAG_CY);
+    switch (group)
+    {
+        case 0: case 1:
+        {
+            Lane16 sum = Widen(a) + Widen(v) + cy;
+            res = Narrow(sum);
+            f = FlagsZSP(res) | (Narrow(sum >> 8) & FLAG_CY) | ((a ^ v ^ res) & FLAG_AC);
+            break;
+        }
+        case 2: case 3: case 7:
+        {
+            Lane16 diff = Widen(a) - Widen(v) - cy;
+            res = Narrow(diff);
+            f = FlagsZSP(res) | (Narrow(diff >> 8) & FLAG_CY) | (~(a ^ v ^ res) & FLAG_AC);
+            break;
+        }
+        case 4:
+            res = a & v;
+            f = FlagsZSP(res) | (((a | v) & 0x08) << 1);
+            break;
+        case 5:
+            res = a ^ v;
+            f = FlagsZSP(res);
+            break;
+        default:
+            res = a | v;
+            f = FlagsZSP(res);
+            break;
+    }
+    if (group != 7)
+        ls->r[7] = Blend8(m, res, a);
+    ls->f = Blend8(m, f, ls->f);
+}
+
+/* Executes op for the lanes in m (bits holds the same set). Returns 0,
+   having changed nothing, for the instructions left to Emulate8080. */
+static int Step(Lockstep8080* ls, const uint8_t *op, Lane8 m, unsigned bits)
+{
+    uint8_t code = op[0];
+    int dst = (code >> 3) & 7, src = code & 7;
+    Lane16 m16 = Widen16(m);
+    Lane16 imm = Splat16((op[2] << 8) | op[1]);
+    Lane16 hl = Pair(ls, HL);
+    Lane16 next = ls->pc + lengths8080[code];
+    Lane8 taken = {0};          //lanes a conditional CALL or RET went through
+
+    if (code >= 0x40 && code < 0x80 && code != 0x76)            //MOV
+    {
+        Lane8 v = (src == 6) ? Load8(ls, &hl, bits) : ls->r[src];
+        if (dst == 6)
+            Store8(ls, &hl, v, bits);
+        else
+            ls->r[dst] = Blend8(m, v, ls->r[dst]);
+    }
+    else if (code >= 0x80 && code < 0xc0)                       //ALU A,r
+        Alu(ls, dst, (src == 6) ? Load8(ls, &hl, bits) : ls->r[src], m);
+    else if ((code & 0xc7) == 0xc6)                             //ALU A,imm
+        Alu(ls, dst, (Lane8) {0} + op[1], m);
+    else if ((code & 0xc6) == 0x04)                             //INR, DCR
+    {
+        Lane8 x = (dst == 6) ? Load8(ls, &hl, bits) : ls->r[dst];
+        Lane8 res, ac;
+        if (code & 1)
+        {
+            res = x - 1;
+            ac = (Lane8) ((res & 0x0f) != 0x0f) & FLAG_AC;
+        }
+        else
+        {
+            res = x + 1;
+            ac = (Lane8) ((res & 0x0f) == 0) & FLAG_AC;
+        }
+        ls->f = Blend8(m, FlagsZSP(res) | ac | (ls->f & FLAG_CY), ls->f);
+        if (dst == 6)
+            Store8(ls, &hl, res, bits);
+        else
+            ls->r[dst] = Blend8(m, res, ls->r[dst]);
+    }
+    else if ((code & 0xc7) == 0x06)                             //MVI
+    {
+        Lane8 v = (Lane8) {0} + op[1];
+        if (dst == 6)
+            Store8(ls, &hl, v, bits);
+        else
+            ls->r[dst] = Blend8(m, v, ls->r[dst]);
+    }
+    else if ((code & 0xc7) == 0xc2)                             //Jcc
+        next = Blend16(Widen16(Condition(ls, dst)), imm, next);
+    else if ((code & 0xc7) == 0xc4)                             //Ccc
+    {
+        taken = Condition(ls, dst) & m;
+        Push(ls, &next, taken, Bits(taken));
+        next = Blend16(Widen16(taken), imm, next);
+    }
+    else if ((code & 0xc7) == 0xc0)                             //Rcc
+    {
+        taken = Condition(ls, dst) & m;
+        Lane16 ret;
+        Pop(ls, &ret, taken, Bits(taken));
+        next = Blend16(Widen16(taken), ret, next);
+    }
+    else if ((code & 0xc7) == 0xc7)                             //RST
+    {
+        Push(ls, &next, m, bits);
+        next = Splat16(code & 0x38);
+    }
+    else if ((code & 0xcf) == 0x01)                             //LXI
+    {
+        if (code == 0x31)
+            ls->sp = Blend16(m16, imm, ls->sp);
+        else
+            SetPair(ls, dst & 6, &imm, m);
+    }
+    else if ((code & 0xc7) == 0x03)                             //INX, DCX
+    {
+        uint16_t step = (code & 0x08) ? 0xffff : 1;
+        if (code == 0x33 || code == 0x3b)
+            ls->sp = Blend16(m16, ls->sp + step, ls->sp);
+        else
+        {
+            Lane16 rp = Pair(ls, dst & 6) + step;
+            SetPair(ls, dst & 6, &rp, m);
+        }
+    }
+    else if ((code & 0xcf) == 0x09)                             //DAD
+    {
+        Lane16 sum = hl + ((code == 0x39) ? ls->sp : Pair(ls, dst & 6));
+        Lane8 cy = Narrow((Lane16) (sum < hl)) & FLAG_CY;
+        SetPair(ls, HL, &sum, m);
+        ls->f = Blend8(m, (ls->f & ~FLAG_CY) | cy, ls->f);
+    }
+    else if ((code & 0xcb) == 0xc1)                             //POP, PUSH
+    {
+        int pair = (code >> 3) & 6;
+        if (code & 0x04)
+        {
+            Lane16 v = (pair == 6) ? (Widen(ls->r[7]) << 8) | Widen(ls->f) : Pair(ls, pair);
+            Push(ls, &v, m, bits);
+        }
+        else
+        {
+            Lane16 v;
+            Pop(ls, &v, m, bits);
+            if (pair == 6)
+            {
+                ls->r[7] = Blend8(m, Narrow(v >> 8), ls->r[7]);
+                ls->f = Blend8(m, (Narrow(v) & 0xd5) | 0x02, ls->f);
+            }
+            else
+                SetPair(ls, pair, &v, m);
+        }
+    }
+    else switch (code)
+    {
+        case 0x00: case 0x08: case 0x10: case 0x18:             //NOP
+        case 0x20: case 0x28: case 0x30: case 0x38:
+            break;
+        case 0x02: case 0x12:                                   //STAX
+        {
+            Lane16 rp = Pair(ls, dst & 6);
+            Store8(ls, &rp, ls->r[7], bits);
+            break;
+        }
+        case 0x0a: case 0x1a:                                   //LDAX
+        {
+            Lane16 rp = Pair(ls, dst & 6);
+            ls->r[7] = Blend8(m, Load8(ls, &rp, bits), ls->r[7]);
+            break;
+        }
+        case 0x22:                                              //SHLD
+            Store16(ls, &imm, &hl, bits);
+            break;
+        case 0x2a:                                              //LHLD
+        {
+            Lane16 v;
+            Load16(ls, &imm, &v, bits);
+            SetPair(ls, HL, &v, m);
+            break;
+        }
+        case 0x32:                                              //STA
+            Store8(ls, &imm, ls->r[7], bits);
+            break;
+        case 0x3a:                                              //LDA
+            ls->r[7] = Blend8(m, Load8(ls, &imm, bits), ls->r[7]);
+            break;
+        case 0x07: case 0x0f: case 0x17: case 0x1f:             //RLC RRC RAL RAR
+        {
+            Lane8 a = ls->r[7], res, cy;
+            Lane8 in = ls->f & FLAG_CY;
+            if (code & 0x08)
+            {
+                cy = a & 1;
+                res = (a >> 1) | ((code == 0x0f ? cy : in) << 7);
+            }
+            else
+            {
+                cy = a >> 7;
+                res = (a << 1) | (code == 0x07 ? cy : in);
+            }
+            ls->r[7] = Blend8(m, res, a);
+            ls->f = Blend8(m, (ls->f & ~FLAG_CY) | cy, ls->f);
+            break;
+        }
+        case 0x2f:                                              //CMA
+            ls->r[7] = Blend8(m, ~ls->r[7], ls->r[7]);
+            break;
+        case 0x37:                                              //STC
+            ls->f |= m & FLAG_CY;
+            break;
+        case 0x3f:                                              //CMC
+            ls->f ^= m & FLAG_CY;
+            break;
+        case 0xc3: case 0xcb:                                   //JMP
+            next = imm;
+            break;
+        case 0xcd: case 0xdd: case 0xed: case 0xfd:             //CALL
+            Push(ls, &next, m, bits);
+            next = imm;
+            break;
+        case 0xc9: case 0xd9:                                   //RET
+            Pop(ls, &next, m, bits);
+            break;
+        case 0xe3:                                              //XTHL
+        {
+            Lane16 v;
+            Load16(ls, &ls->sp, &v, bits);
+            Store16(ls, &ls->sp, &hl, bits);
+            SetPair(ls, HL, &v, m);
+            break;
+        }
+        case 0xe9:                                              //PCHL
+            next = hl;
+            break;
+        case 0xeb:                                              //XCHG
+        {
+            Lane16 de = Pair(ls, 2);
+            SetPair(ls, 2, &hl, m);
+            SetPair(ls, HL, &de, m);
+            break;
+        }
+        case 0xf9:                                              //SPHL
+            ls->sp = Blend16(m16, hl, ls->sp);
+            break;
+        default:                                                //DAA, IN, OUT, HLT, DI, EI
+            return 0;
+    }
+    ls->pc = Blend16(m16, next, ls->pc);
+    ls->spent += __builtin_convertvector((m & cycles8080[code]) + (taken & CONDITIONAL_TAKEN), Lane32);
+    ls->executed += __builtin_convertvector(m & 1, Lane32);
+    return 1;
+}
+
+//moves machine i's registers into its lane, to run until `end`
+static void LoadLane(Lockstep8080* ls, int i, uint64_t end)
+{
+    State8080 *s = ls->machines[i];
+    SyncFlags(s);
+    ls->r[0][i] = s->b;
+    ls->r[1][i] = s->c;
+    ls->r[2][i] = s->d;
+    ls->r[3][i] = s->e;
+    ls->r[4][i] = s->h;
+    ls->r[5][i] = s->l;
+    ls->r[7][i] = s->a;
+    ls->f[i] = s->cc.s << 7 | s->cc.z << 6 | s->cc.ac << 4 | s->cc.p << 2 | 0x02 | s->cc.cy;
+    ls->sp[i] = s->sp;
+    ls->pc[i] = s->pc;
+    ls->spent[i] = 0;
+    ls->limit[i] = (uint32_t) (end - s->cycles);
+    ls->executed[i] = 0;
+    ls->live[i] = 0xff;
+}
+
+static void StoreLane(Lockstep8080* ls, int i)
+{
+    State8080 *s = ls->machines[i];
+    uint8_t f = ls->f[i];
+    s->b = ls->r[0][i];
+    s->c = ls->r[1][i];
+    s->d = ls->r[2][i];
+    s->e = ls->r[3][i];
+    s->h = ls->r[4][i];
+    s->l = ls->r[5][i];
+    s->a = ls->r[7][i];
+    s->cc.s = (f & FLAG_S) != 0;
+    s->cc.z = (f & FLAG_Z) != 0;
+    s->cc.ac = (f & FLAG_AC) != 0;
+    s->cc.p = (f & FLAG_P) != 0;
+    s->cc.cy = (f & FLAG_CY) != 0;
+    s->flag_kind = FLAGS_NONE;
+    s->sp = ls->sp[i];
+    s->pc = ls->pc[i];
+    s->cycles += ls->spent[i];
+    s->instructions += ls->executed[i];
+    ls->live[i] = 0;
+}
+
+/* One instruction of lane i on its own. If it was EI with an interrupt
+   waiting or HLT, Run8080 finishes the lane's slice the way it would
+   have without lockstep. */
+static void Fallback(Lockstep8080* ls, int i, uint64_t end)
+{
+    State8080 *s = ls->machines[i];
+    StoreLane(ls, i);
+    //handlers may look at any register, but IN and OUT need no more
+    //than the machine being up to date
+    uint8_t op = s->memory[s->pc];
+    if (op == 0xdb || op == 0xd3)
+    {
+        uint8_t port = s->memory[(uint16_t) (s->pc + 1)];
+        if (op == 0xdb)
+            s->a = PortRead(s, port);
+        else
+            PortWrite(s, port, s->a);
+        s->pc += 2;
+        s->cycles += cycles8080[op];
+        s->instructions++;
+    }
+    else
+        Emulate8080(s);
+    if (s->stop || s->halted)
+    {
+        s->stop = 0;
+        if (s->cycles < end)
+            Run8080(s, (int) (end - s->cycles));
+    }
+    else if (s->cycles < end)
+        LoadLane(ls, i, end);
+}
+
+Lockstep8080* LockstepCreate(State8080 **machines, int lanes)
+{
+    Lockstep8080 *ls = aligned_alloc(64, (sizeof(Lockstep8080) + 63) & ~(size_t) 63);
+    memset(ls, 0, sizeof(Lockstep8080));
+    ls->lanes = (lanes < LOCKSTEP_LANES) ? lanes : LOCKSTEP_LANES;
+    for (int i = 0; i < ls->lanes; i++)
+        ls->machines[i] = machines[i];
+    return ls;
+}
+
+void LockstepFree(Lockstep8080* ls)
+{
+    free(ls);
+}
+
+/* Runs every machine until its cycle count reaches `end`, taking
+   interrupts and skipping HLT the way Run8080 does. */
+void LockstepRun(Lockstep8080* ls, uint64_t end)
+{
+    for (int i = 0; i < ls->lanes; i++)
+    {
+        State8080 *s = ls->machines[i];
+        if (s->cycles >= end)
+            continue;
+        Accept8080(s);
+        if (s->halted)
+            s->cycles = end;
+        else if (s->cycles < end)
+            LoadLane(ls, i, end);
+    }
+
+    for (;;)
+    {
+        Lane32 left = ls->limit - ls->spent;
+        Lane8 active = ls->live & (Lane8) __builtin_convertvector((Mask32) (ls->spent < ls->limit), Mask8);
+        unsigned bits = Bits(active);
+        if (bits == 0)
+            break;
+
+        //the lane furthest behind picks the instruction
+        int lead = __builtin_ctz(bits);
+        for (unsigned b = bits & (bits - 1); b; b &= b - 1)
+        {
+            int i = __builtin_ctz(b);
+            if (left[i] > left[lead])
+                lead = i;
+        }
+        uint16_t pc = ls->pc[lead];
+        State8080 *s = ls->machines[lead];
+        uint8_t op[3];
+        for (int k = 0; k < 3; k++)
+            op[k] = s->memory[(uint16_t) (pc + k)];
+        int len = lengths8080[op[0]];
+
+        Lane8 m = active & (Lane8) __builtin_convertvector((Mask16) (ls->pc == pc), Mask8);
+        bits = Bits(m);
+        //ROM is the same in every lane; RAM has to be compared
+        if (!(s->page_flags[pc >> 8] & PAGE_ROM) ||
+            !(s->page_flags[(uint16_t) (pc + len - 1) >> 8] & PAGE_ROM))
+        {
+            for (unsigned b = bits & ~(1u << lead); b; b &= b - 1)
+            {
+                int i = __builtin_ctz(b);
+                for (int k = 0; k < len; k++)
+                    if (ls->machines[i]->memory[(uint16_t) (pc + k)] != op[k])
+                    {
+                        m[i] = 0;
+                        bits &= ~(1u << i);
+                        break;
+                    }
+            }
+        }
+
+        ls->steps++;
+        ls->lane_steps += __builtin_popcount(bits);
+        if (!Step(ls, op, m, bits))
+            for (; bits; bits &= bits - 1)
+                Fallback(ls, __builtin_ctz(bits), end);
+    }
+
+    for (int i = 0; i < ls->lanes; i++)
+        if (ls->live[i])
+            StoreLane(ls, i);
+}
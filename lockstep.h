@@ -0,0 +1,42 @@
+#ifndef LOCKSTEP
+#define LOCKSTEP
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* Runs up to LOCKSTEP_LANES machines with the same ROM side by side,
+   their registers held in vector lanes. Each step takes the pc of the
+   lane furthest behind, and every lane at that pc with the same
+   instruction bytes executes it in one pass. Memory stays per machine,
+   so loads and stores loop over the lanes; IN, OUT, EI, DI, HLT and DAA
+   run one lane at a time on the machine itself. Between runs the
+   registers live in the machines as usual, so inputs, interrupts and
+   digests work on them directly. Trace, JIT, predecode, profile and
+   debugger settings on the machines are ignored. */
+
+#define LOCKSTEP_LANES  16
+
+typedef uint8_t Lane8 __attribute__((vector_size(LOCKSTEP_LANES)));
+typedef uint16_t Lane16 __attribute__((vector_size(LOCKSTEP_LANES * 2)));
+typedef uint32_t Lane32 __attribute__((vector_size(LOCKSTEP_LANES * 4)));
+
+typedef struct Lockstep8080{
+    int         lanes;
+    State8080   *machines[LOCKSTEP_LANES];
+    Lane8       r[8];       //B C D E H L - A, indexed like the opcode fields
+    Lane8       f;          //flags, laid out as PUSH PSW stores them
+    Lane16      sp;
+    Lane16      pc;
+    Lane32      spent;      //cycles run since the lane was loaded
+    Lane32      limit;      //cycles it may run in this call
+    Lane32      executed;   //instructions run since the lane was loaded
+    Lane8       live;       //0xff while the lane's registers are here
+    uint64_t    steps;      //vector steps taken
+    uint64_t    lane_steps; //instructions they ran across all lanes
+}Lockstep8080;
+
+Lockstep8080* LockstepCreate(State8080 **machines, int lanes);
+void LockstepFree(Lockstep8080* ls);
+void LockstepRun(Lockstep8080* ls, uint64_t end);
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.h"
+#include "trace.h"
+#include "jit.h"
+#include "manifest.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "video.h"
+#include "framehash.h"
+#include "cfg.h"
+#include "profile.h"
+#include "gdb.h"
+
+#define CPU_HZ              2000000
+#define HALF_FRAME_CYCLES   (CPU_HZ / 120)
+#define PROFILE_FRAMES      600     //a long run rewrites its profile this often
+
+static void SaveProfile(Profile8080 *profile, const char *prefix)
+{
+    char name[512];
+    snprintf(name, sizeof(name), "%s.flat", prefix);
+    int failed = ProfileWriteFlat(profile, name);
+    snprintf(name, sizeof(name), "%s.folded", prefix);
+    failed |= ProfileWriteFolded(profile, name);
+    if (failed)
+        printf("warning: Couldn't write the profile to %s.*\n", prefix);
+}
+
+int main(int argc, char**argv)
+{
+    int done = 0;
+    int vblankcycles = 0;
+    const char *romset = "invaders.roms";
+    int manifest_flags = 0;
+    const char *restore = NULL, *save = NULL;
+    long save_frames = 0;
+    const char *record = NULL, *play = NULL;
+    long keyframes = 0;
+    const char *dump = NULL;
+    long dump_frames = 0;
+    FILE *hashlog = NULL;
+    const char *blockmap = NULL;
+    const char *profile = NULL, *symbols = NULL;
+    const char *debugger = NULL;
+    State8080* state = Initialize8080();
+
+    for (int i = 1; i < argc; i++)
+    {
+        //-t keeps the last instructions in a ring buffer and prints them
+        //when the run ends
+        if (strcmp(argv[i], "-t") == 0)
+            state->trace = TraceCreate(4096);
+        //-j translates hot blocks to host code
+        else if (strcmp(argv[i], "-j") == 0)
+        {
+            state->jit = JitCreate();
+            if (state->jit == NULL)
+                printf("warning: no JIT on this host, interpreting\n");
+        }
+        //-f n prefix profiles one instruction in n, written to prefix.flat
+        //and prefix.folded; -y names routines from a romscan symbol file
+        else if (strcmp(argv[i], "-f") == 0 && i + 2 < argc)
+        {
+            state->profile = ProfileCreate(atol(argv[++i]));
+            profile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-y") == 0 && i + 1 < argc)
+            symbols = argv[++i];
+        //-g waits for gdb on a localhost port, or a Unix socket path
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            debugger = argv[++i];
+        //-b translates the blocks in a romscan block map up front
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            blockmap = argv[++i];
+#if USE_COMPUTED_GOTO
+        //-p caches decoded instructions by pc
+        else if (strcmp(argv[i], "-p") == 0)
+            state->decoded = PredecodeCreate();
+#endif
+        //-r names the ROM-set manifest, -c loads ROMs that fail their CRC
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            romset = argv[++i];
+        else if (strcmp(argv[i], "-c") == 0)
+            manifest_flags |= MANIFEST_ANY_CRC;
+        //-s starts from a snapshot, -S saves one after n frames and exits
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            restore = argv[++i];
+        else if (strcmp(argv[i], "-S") == 0 && i + 2 < argc)
+        {
+            save_frames = atol(argv[++i]);
+            save = argv[++i];
+        }
+        //-R records inputs and interrupts to a log, -P plays one back;
+        //-k n also snapshots every n frames while recording, to seek from
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc)
+            record = argv[++i];
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            play = argv[++i];
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+            keyframes = atol(argv[++i]);
+        //-d n prefix writes the screen to prefix-<frame>.png every n frames
+        else if (strcmp(argv[i], "-d") == 0 && i + 2 < argc)
+        {
+            dump_frames = atol(argv[++i]);
+            dump = argv[++i];
+        }
+        //-H writes a hash of the screen and registers every frame
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc)
+        {
+            hashlog = FrameLogCreate(argv[++i]);
+            if (hashlog == NULL)
+            {
+                printf("error: Couldn't create %s\n", argv[i]);
+                exit(1);
+            }
+        }
+    }
+
+    uint8_t rom_pages[256] = { 0 };
+    if (LoadManifest(romset, state->memory, manifest_flags, rom_pages) < 0)
+        exit(1);
+    for (int page = 0; page < 256; page++)
+        if (rom_pages[page])
+            ProtectRom(state, page << 8, (page + 1) << 8);
+    MachineAttach(state);
+    if (blockmap)
+    {
+        uint16_t *starts = malloc(0x10000 * sizeof(uint16_t));
+        int n = CfgLoadBlocks(blockmap, starts, 0x10000);
+        if (n < 0)
+        {
+            printf("error: Couldn't read %s\n", blockmap);
+            exit(1);
+        }
+        if (state->jit)
+            JitPreload(state, starts, n);
+        else
+            printf("warning: -b without -j has nothing to preload\n");
+        free(starts);
+    }
+    if (symbols && state->profile && ProfileLoadSymbols(state->profile, symbols) < 0)
+    {
+        printf("error: Couldn't read %s\n", symbols);
+        exit(1);
+    }
+    if (dump || hashlog)
+        VideoTrack(state);
+
+    //snapshots only store what differs from the freshly loaded machine
+    uint8_t *base = malloc(0x10000);
+    memcpy(base, state->memory, 0x10000);
+    if (restore && SnapshotLoadFile(state, base, restore) != 0)
+    {
+        printf("error: Couldn't restore %s\n", restore);
+        exit(1);
+    }
+
+    if (record || play)
+    {
+        const char *log = record ? record : play;
+        Replay8080 *replay = ReplayCreate(log, record ? REPLAY_RECORD : REPLAY_PLAY);
+        if (replay == NULL)
+        {
+            printf("error: Couldn't open %s\n", log);
+            exit(1);
+        }
+        ReplayAttach(state, replay);
+        //playing back from a snapshot starts partway into the log
+        if (play)
+            ReplaySeek(state->replay, state->cycles);
+    }
+
+    if (debugger && GdbAttach(state, debugger) != 0)
+    {
+        printf("error: Couldn't listen for gdb on %s\n", debugger);
+        exit(1);
+    }
+
+    //the board interrupts at mid-screen and again at vblank, so the
+    //emulation advances in half-frame slices of the 2MHz clock; slices
+    //follow the cycle count so a restored snapshot stays in step
+    long halves = 0;
+    uint32_t undrawn[VIDEO_WORDS] = { 0 };
+    static FrameHasher hasher;
+    while (done == 0)
+    {
+        vblankcycles = HALF_FRAME_CYCLES - state->cycles % HALF_FRAME_CYCLES;
+        Run8080(state, vblankcycles);
+        MachineInterrupt(state, HALF_FRAME_CYCLES);
+        halves++;
+
+        //with interrupts off nothing wakes a halted CPU, so the run is over
+        if (state->halted && !state->int_enable)
+        {
+            printf("CPU halted with interrupts disabled at %04x\n", state->pc);
+            done = 1;
+        }
+
+        if (record)
+            ReplayFlush(state->replay);
+
+        //frame captures happen at vblank
+        uint64_t frame = state->cycles / (2 * HALF_FRAME_CYCLES);
+        int vblank = (state->cycles / HALF_FRAME_CYCLES) % 2 == 0;
+
+        if (vblank && (dump || hashlog))
+        {
+            uint32_t lines[VIDEO_WORDS];
+            VideoTakeDirty(state, lines);
+            for (int i = 0; i < VIDEO_WORDS; i++)
+                undrawn[i] |= lines[i];
+            if (hashlog)
+                FrameLogWrite(hashlog, FrameHash(&hasher, state, lines));
+        }
+
+        if (vblank && dump && dump_frames > 0 && frame % dump_frames == 0)
+        {
+            //only the lines written since the last dump are redrawn
+            static uint8_t screen[VIDEO_WIDTH * VIDEO_HEIGHT];
+            char name[512];
+            snprintf(name, sizeof(name), "%s-%llu.png", dump, (unsigned long long) frame);
+            VideoGrayLines(state->memory, screen, undrawn);
+            memset(undrawn, 0, sizeof(undrawn));
+            VideoWritePNG(name, screen);
+        }
+
+        if (vblank && record && keyframes > 0 && frame % keyframes == 0)
+        {
+            char name[512];
+            snprintf(name, sizeof(name), "%s.%llu.snap", record, (unsigned long long) frame);
+            SnapshotSaveFile(state, base, name);
+        }
+
+        if (vblank && profile && frame % PROFILE_FRAMES == 0)
+            SaveProfile(state->profile, profile);
+
+        if (save && halves >= save_frames * 2)
+        {
+            if (SnapshotSaveFile(state, base, save) != 0)
+            {
+                printf("error: Couldn't save %s\n", save);
+                exit(1);
+            }
+            done = 1;
+        }
+    }
+    if (state->trace)
+        TraceDump(state->trace);
+    if (hashlog)
+        fclose(hashlog);
+    if (profile)
+        SaveProfile(state->profile, profile);
+    Free8080(state);
+    return 0;
+}
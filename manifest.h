@@ -0,0 +1,25 @@
+#ifndef MANIFEST
+#define MANIFEST
+
+#include <stdint.h>
+
+/* ROM-set manifests: one ROM per line,
+
+       # name      file        load    size    crc32
+       invaders.h  invaders.h  0x0000  0x0800  734f5ad8
+
+   with load and size in hex, file paths relative to the manifest and
+   "-" for an unknown checksum. Each file is read into memory and
+   checked against its declared size, the 64K address space and its
+   CRC-32; a wrong CRC is an error unless flags has MANIFEST_ANY_CRC.
+   Returns the end of the highest ROM, for RomImageCreate, or -1 after
+   printing what was wrong; memory may then hold some of the ROMs. If
+   rom_pages isn't NULL, each 256-byte page a ROM fills is set to 1 in
+   it, for ProtectRom, so RAM between ROMs stays writable. */
+
+#define MANIFEST_ANY_CRC    1   //load ROMs whose CRC-32 doesn't match, with a warning
+
+int LoadManifest(const char *path, uint8_t *memory, int flags, uint8_t *rom_pages);
+uint32_t Crc32(const uint8_t *data, uint32_t len);
+
+#endif
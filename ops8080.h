@@ -0,0 +1,1175 @@
+/* Instruction bodies shared by the interpreter cores in emulator.c.
+   Deliberately has no include guard: it is pasted into each core, which
+   first defines
+     OP(n)   the label that starts opcode n (a switch case, or a
+             computed-goto target)
+     NEXT    what to do once the instruction is done
+     IMM8    the byte after the opcode
+     IMM16   the little-endian word after the opcode
+   and provides `state` (pc already past the opcode byte) and `cycles`
+   (the table cost of the instruction). */
+
+        OP(0x00):   NEXT;
+        OP(0x01):   state->c = IMM8;
+                    state->b = (IMM16 >> 8);
+                    state->pc +=2;
+                    NEXT;
+        OP(0x02):   //STAX B
+                    {
+                    uint16_t x = (state->b << 8) | state->c;
+                    WriteMem(state, x, state->a);
+                    }
+                    NEXT;
+        OP(0x03):   //INX B
+                    {
+                    state->c++;
+                    if (state->c == 0) state->b++;
+                    }
+                    NEXT;
+        OP(0x04):   //INR B
+                    {
+                    uint8_t x = state->b + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->b = x;
+                    }
+                    NEXT;
+        OP(0x05):   //DCR B
+                    {
+                    uint8_t x = state->b -1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->b = x;
+                    }
+                    NEXT;
+        OP(0x06):   //MVI B
+                    {
+                    state->b = IMM8;
+                    state->pc += 1;
+                    NEXT;
+                    }
+        OP(0x07):   //RLC
+                    {
+                    uint8_t x = state->a;
+                    state->a = (x << 1) | (x >> 7);
+                    SetCarry(state, x >> 7);
+                    }
+                    NEXT;
+        OP(0x08):   //NOP (undocumented)
+                    NEXT;
+        OP(0x09):   //DAD B
+                    {
+                    uint32_t hl = (state->h << 8) | state->l;
+                    uint32_t bc = (state->b << 8) | state->c;
+                    uint32_t res = hl + bc;
+                    state->h = (res & 0xff00 ) >> 8;
+                    state->l = (res & 0xff);
+                    SetCarry(state, (res & 0xffff0000) != 0);
+                    }
+                    NEXT;
+        OP(0x0a):   //LDAX B
+                    {
+                    uint16_t x = (state->b << 8) | state->c;
+                    state->a = state->memory[x];
+                    }
+                    NEXT;
+        OP(0x0b):   //DCX B
+                    {
+                    if (state->c == 0) state->b--;
+                    state->c--;
+                    }
+                    NEXT;
+        OP(0x0c):   //INR C
+                    {
+                    uint8_t x = state->c + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->c = x;
+                    }
+                    NEXT;
+        OP(0x0d):   //DCR C
+                    {
+                    uint8_t x = state->c -1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->c = x;
+                    }
+                    NEXT;
+        OP(0x0e):   //MVI C
+                    {
+                    state->c = IMM8;
+                    state->pc+=1;
+                    }
+                    NEXT;
+        OP(0x0f):   //RRC
+                    {
+                    uint8_t x = state->a;
+                    state->a = ((x & 1) << 7) | (x >> 1);
+                    SetCarry(state, 1 == (x&1));
+                    }
+                    NEXT;
+        OP(0x10):   //NOP (undocumented)
+                    NEXT;
+        OP(0x11):   //LXI D
+                    {
+                    state->d = (IMM16 >> 8);
+                    state->e = IMM8;
+                    state->pc += 2;
+                    NEXT;
+                    }
+        OP(0x12):   //STAX D
+                    {
+                    uint16_t x = (state->d << 8) | state->e;
+                    WriteMem(state, x, state->a);
+                    }
+                    NEXT;
+        OP(0x13):   //INX D
+                    {
+                    state->e++;
+                    if (state->e ==0) state->d++;
+                    NEXT;
+                    }
+        OP(0x14):   //INR D
+                    {
+                    uint8_t x = state->d + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->d = x;
+                    }
+                    NEXT;
+        OP(0x15):   //DCR D
+                    {
+                    uint8_t x = state->d - 1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->d = x;
+                    }
+                    NEXT;
+        OP(0x16):   //MVI D
+                    {
+                    state->d = IMM8;
+                    state->pc += 1;
+                    }
+                    NEXT;
+        OP(0x17):   //RAL
+                    {
+                    uint8_t x = state->a;
+                    state->a = (x << 1) | FlagCY(state);
+                    SetCarry(state, x >> 7);
+                    }
+                    NEXT;
+        OP(0x18):   //NOP (undocumented)
+                    NEXT;
+        OP(0x19):   //DAD D
+                    {
+                    uint32_t hl = (state->h << 8) | state->l;
+                    uint32_t de = (state->d << 8) | state->e;
+                    uint32_t res = hl + de;
+                    state->h = (res & 0xff00 ) >> 8;
+                    state->l = (res & 0xff);
+                    SetCarry(state, (res & 0xffff0000) != 0);
+                    }
+                    NEXT;
+        OP(0x1a):   //LDAX D
+                    {
+                    uint16_t x = (state->d <<8) | state->e; 
+                    state->a = state->memory[x];
+                    NEXT;
+                    }
+        OP(0x1b):   //DCX D
+                    {
+                    if (state->e == 0) state->d--;
+                    state->e--;
+                    }
+                    NEXT;
+        OP(0x1c):   //INR E
+                    {
+                    uint8_t x = state->e + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->e = x;
+                    }
+                    NEXT;
+        OP(0x1d):   //DCR E
+                    {
+                    uint8_t x = state->e - 1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->e = x;
+                    }
+                    NEXT;
+        OP(0x1e):   //MVI E
+                    {
+                    state->e = IMM8;
+                    state->pc += 1;
+                    }
+                    NEXT;
+        OP(0x1f):   //RAR
+                    {
+                    uint8_t x = state->a;
+                    state->a = (FlagCY(state) << 7) | (x >> 1);
+                    SetCarry(state, x & 1);
+                    }
+                    NEXT;
+        OP(0x20):   //NOP (undocumented)
+                    NEXT;
+        OP(0x21):   //LXI H
+                    {
+                    state->l = IMM8;
+                    state->h = (IMM16 >> 8);
+                    state->pc += 2;
+                    NEXT;
+                    }
+        OP(0x22):   //SHLD adr
+                    {
+                    uint16_t x = IMM16;
+                    WriteMem(state, x, state->l);
+                    WriteMem(state, x + 1, state->h);
+                    state->pc += 2;
+                    }
+                    NEXT;
+        OP(0x23):   //INX H
+                    {
+                    state->l++;
+                    if (state->l ==0) state->h++;
+                    NEXT;
+                    }
+        OP(0x24):   //INR H
+                    {
+                    uint8_t x = state->h + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->h = x;
+                    }
+                    NEXT;
+        OP(0x25):   //DCR H
+                    {
+                    uint8_t x = state->h - 1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->h = x;
+                    }
+                    NEXT;
+        OP(0x26):   //MVI H
+                    {
+                    state->h = IMM8;
+                    state->pc += 1;
+                    }
+                    NEXT;
+        OP(0x27):   //DAA
+                    Daa(state);
+                    NEXT;
+        OP(0x28):   //NOP (undocumented)
+                    NEXT;
+        OP(0x29):   //DAD H
+                    {
+                    uint32_t x = (state->h << 8) | (state->l);
+                    uint32_t hl = x +x;
+                    state->h = (hl & 0xff00) >> 8;
+                    state->l = hl & 0xff;
+                    SetCarry(state, (hl & 0xffff0000) != 0);
+                    }
+                    NEXT;
+        OP(0x2a):   //LHLD adr
+                    {
+                    uint16_t x = IMM16;
+                    state->l = state->memory[x];
+                    state->h = state->memory[(uint16_t) (x + 1)];
+                    state->pc += 2;
+                    }
+                    NEXT;
+        OP(0x2b):   //DCX H
+                    {
+                    if (state->l == 0) state->h--;
+                    state->l--;
+                    }
+                    NEXT;
+        OP(0x2c):   //INR L
+                    {
+                    uint8_t x = state->l + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->l = x;
+                    }
+                    NEXT;
+        OP(0x2d):   //DCR L
+                    {
+                    uint8_t x = state->l - 1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->l = x;
+                    }
+                    NEXT;
+        OP(0x2e):   //MVI L
+                    {
+                    state->l = IMM8;
+                    state->pc += 1;
+                    }
+                    NEXT;
+        OP(0x2f):   //CMA
+                    {
+                    state->a = ~state->a;
+                    NEXT;
+                    }
+        OP(0x30):   //NOP (undocumented)
+                    NEXT;
+        OP(0x31):   //LXI SP
+                    {
+                    state->sp = IMM16;
+                    state->pc += 2;
+                    NEXT;
+                    }
+        OP(0x32):   //STA adr
+                    {
+                    uint16_t adr = IMM16;
+                    WriteMem(state, adr, state->a);
+                    state->pc +=2;
+                    }
+                    NEXT;
+        OP(0x33):   //INX SP
+                    state->sp++;
+                    NEXT;
+        OP(0x34):   //INR M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    uint8_t res = state->memory[x] + 1;
+                    IncDecFlags(state, FLAGS_INC, res);
+                    WriteMem(state, x, res);
+                    }
+                    NEXT;
+        OP(0x35):   //DCR M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    uint8_t res = state->memory[x] - 1;
+                    IncDecFlags(state, FLAGS_DEC, res);
+                    WriteMem(state, x, res);
+                    }
+                    NEXT;
+        OP(0x36):   //MVI M
+                    {
+                    uint16_t x = (state->h << 8) | state-> l;
+                    WriteMem(state, x, IMM8);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0x37):   //STC
+                    SetCarry(state, 1);
+                    NEXT;
+        OP(0x38):   //NOP (undocumented)
+                    NEXT;
+        OP(0x39):   //DAD SP
+                    {
+                    uint32_t hl = (state->h << 8) | state->l;
+                    uint32_t res = hl + state->sp;
+                    state->h = (res & 0xff00) >> 8;
+                    state->l = (res & 0xff);
+                    SetCarry(state, (res & 0xffff0000) != 0);
+                    }
+                    NEXT;
+        OP(0x3a):   //LDA adr
+                    {
+                    uint16_t x = IMM16;
+                    state->a = state->memory[x];
+                    state->pc +=2;
+                    }
+                    NEXT;
+        OP(0x3b):   //DCX SP
+                    state->sp--;
+                    NEXT;
+        OP(0x3c):   //INR A
+                    {
+                    uint8_t x = state->a + 1;
+                    IncDecFlags(state, FLAGS_INC, x);
+                    state->a = x;
+                    }
+                    NEXT;
+        OP(0x3d):   //DCR A
+                    {
+                    uint8_t x = state->a - 1;
+                    IncDecFlags(state, FLAGS_DEC, x);
+                    state->a = x;
+                    }
+                    NEXT;
+        OP(0x3e):   //MVI A
+                    {
+                    state->a = IMM8;
+                    state->pc += 1;
+                    }
+                    NEXT;
+        OP(0x3f):   //CMC
+                    SetCarry(state, !FlagCY(state));
+                    NEXT;
+        OP(0x40):   //MOV B,B
+                    NEXT;
+        OP(0x41):   state->b = state->c; NEXT;
+        OP(0x42):   state->b = state->d; NEXT;
+        OP(0x43):   state->b = state->e; NEXT;
+        OP(0x44):   state->b = state->h; NEXT;
+        OP(0x45):   state->b = state->l; NEXT;
+        OP(0x46):   //MOV B,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->b = state->memory[x];
+                    }
+                    NEXT;
+        OP(0x47):   state->b = state->a; NEXT;
+        OP(0x48):   state->c = state->b; NEXT;
+        OP(0x49):   //MOV C,C
+                    NEXT;
+        OP(0x4a):   state->c = state->d; NEXT;
+        OP(0x4b):   state->c = state->e; NEXT;
+        OP(0x4c):   state->c = state->h; NEXT;
+        OP(0x4d):   state->c = state->l; NEXT;
+        OP(0x4e):   //MOV C,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->c = state->memory[x];
+                    }
+                    NEXT;
+        OP(0x4f):   state->c = state->a; NEXT;
+        OP(0x50):   state->d = state->b; NEXT;
+        OP(0x51):   state->d = state->c; NEXT;
+        OP(0x52):   //MOV D,D
+                    NEXT;
+        OP(0x53):   state->d = state->e; NEXT;
+        OP(0x54):   state->d = state->h; NEXT;
+        OP(0x55):   state->d = state->l; NEXT;
+        OP(0x56):   //MOV D,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->d = state->memory[x];
+                    NEXT;
+                    }
+        OP(0x57):   state->d = state->a; NEXT;
+        OP(0x58):   state->e = state->b; NEXT;
+        OP(0x59):   state->e = state->c; NEXT;
+        OP(0x5a):   state->e = state->d; NEXT;
+        OP(0x5b):   //MOV E,E
+                    NEXT;
+        OP(0x5c):   state->e = state->h; NEXT;
+        OP(0x5d):   state->e = state->l; NEXT;
+        OP(0x5e):   //MOV E,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->e = state->memory[x];
+                    NEXT;
+                    }
+        OP(0x5f):   state->e = state->a; NEXT;
+        OP(0x60):   state->h = state->b; NEXT;
+        OP(0x61):   state->h = state->c; NEXT;
+        OP(0x62):   state->h = state->d; NEXT;
+        OP(0x63):   state->h = state->e; NEXT;
+        OP(0x64):   //MOV H,H
+                    NEXT;
+        OP(0x65):   state->h = state->l; NEXT;
+        OP(0x66):   //MOV H,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->h = state->memory[x];
+                    NEXT;
+                    }
+        OP(0x67):   state->h = state->a; NEXT;
+        OP(0x68):   state->l = state->b; NEXT;
+        OP(0x69):   state->l = state->c; NEXT;
+        OP(0x6a):   state->l = state->d; NEXT;
+        OP(0x6b):   state->l = state->e; NEXT;
+        OP(0x6c):   state->l = state->h; NEXT;
+        OP(0x6d):   //MOV L,L
+                    NEXT;
+        OP(0x6e):   //MOV L,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->l = state->memory[x];
+                    }
+                    NEXT;
+        OP(0x6f):   //MOV LA
+                    {
+                    state->l = state->a;
+                    }
+                    NEXT;
+        OP(0x70):   //MOV M,B
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->b);
+                    }
+                    NEXT;
+        OP(0x71):   //MOV M,C
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->c);
+                    }
+                    NEXT;
+        OP(0x72):   //MOV M,D
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->d);
+                    }
+                    NEXT;
+        OP(0x73):   //MOV M,E
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->e);
+                    }
+                    NEXT;
+        OP(0x74):   //MOV M,H
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->h);
+                    }
+                    NEXT;
+        OP(0x75):   //MOV M,L
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->l);
+                    }
+                    NEXT;
+        OP(0x76):   //HLT
+                    state->halted = 1;
+                    STOP();
+                    NEXT;
+        OP(0x77):   //MOV M,A
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    WriteMem(state, x, state->a);
+                    }
+                    NEXT;
+        OP(0x78):   state->a = state->b; NEXT;
+        OP(0x79):   state->a = state->c; NEXT;
+        OP(0x7a):   //MOV A,D
+                    {
+                    state->a = state->d;
+                    }
+                    NEXT;
+        OP(0x7b):   //MOV A,E
+                    {
+                    state->a = state->e;
+                    }
+                    NEXT;
+        OP(0x7c):   state->a = state->h; NEXT;
+        OP(0x7d):   state->a = state->l; NEXT;
+        OP(0x7e):   //MOV A,M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->a = state->memory[x];
+                    NEXT;
+                    }
+        OP(0x7f):   //MOV A,A
+                    NEXT;
+        OP(0x80):   //ADD B
+                    Add(state, state->b, 0);
+                    NEXT;
+        OP(0x81):   //ADD C
+                    Add(state, state->c, 0);
+                    NEXT;
+        OP(0x82):   //ADD D
+                    Add(state, state->d, 0);
+                    NEXT;
+        OP(0x83):   //ADD E
+                    Add(state, state->e, 0);
+                    NEXT;
+        OP(0x84):   //ADD H
+                    Add(state, state->h, 0);
+                    NEXT;
+        OP(0x85):   //ADD L
+                    Add(state, state->l, 0);
+                    NEXT;
+        OP(0x86):   //ADD M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    Add(state, state->memory[x], 0);
+                    }
+                    NEXT;
+        OP(0x87):   //ADD A
+                    Add(state, state->a, 0);
+                    NEXT;
+        OP(0x88):   //ADC B
+                    Add(state, state->b, FlagCY(state));
+                    NEXT;
+        OP(0x89):   //ADC C
+                    Add(state, state->c, FlagCY(state));
+                    NEXT;
+        OP(0x8a):   //ADC D
+                    Add(state, state->d, FlagCY(state));
+                    NEXT;
+        OP(0x8b):   //ADC E
+                    Add(state, state->e, FlagCY(state));
+                    NEXT;
+        OP(0x8c):   //ADC H
+                    Add(state, state->h, FlagCY(state));
+                    NEXT;
+        OP(0x8d):   //ADC L
+                    Add(state, state->l, FlagCY(state));
+                    NEXT;
+        OP(0x8e):   //ADC M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    Add(state, state->memory[x], FlagCY(state));
+                    }
+                    NEXT;
+        OP(0x8f):   //ADC A
+                    Add(state, state->a, FlagCY(state));
+                    NEXT;
+        OP(0x90):   //SUB B
+                    Subtract(state, state->b, 0);
+                    NEXT;
+        OP(0x91):   //SUB C
+                    Subtract(state, state->c, 0);
+                    NEXT;
+        OP(0x92):   //SUB D
+                    Subtract(state, state->d, 0);
+                    NEXT;
+        OP(0x93):   //SUB E
+                    Subtract(state, state->e, 0);
+                    NEXT;
+        OP(0x94):   //SUB H
+                    Subtract(state, state->h, 0);
+                    NEXT;
+        OP(0x95):   //SUB L
+                    Subtract(state, state->l, 0);
+                    NEXT;
+        OP(0x96):   //SUB M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    Subtract(state, state->memory[x], 0);
+                    }
+                    NEXT;
+        OP(0x97):   //SUB A
+                    Subtract(state, state->a, 0);
+                    NEXT;
+        OP(0x98):   //SBB B
+                    Subtract(state, state->b, FlagCY(state));
+                    NEXT;
+        OP(0x99):   //SBB C
+                    Subtract(state, state->c, FlagCY(state));
+                    NEXT;
+        OP(0x9a):   //SBB D
+                    Subtract(state, state->d, FlagCY(state));
+                    NEXT;
+        OP(0x9b):   //SBB E
+                    Subtract(state, state->e, FlagCY(state));
+                    NEXT;
+        OP(0x9c):   //SBB H
+                    Subtract(state, state->h, FlagCY(state));
+                    NEXT;
+        OP(0x9d):   //SBB L
+                    Subtract(state, state->l, FlagCY(state));
+                    NEXT;
+        OP(0x9e):   //SBB M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    Subtract(state, state->memory[x], FlagCY(state));
+                    }
+                    NEXT;
+        OP(0x9f):   //SBB A
+                    Subtract(state, state->a, FlagCY(state));
+                    NEXT;
+        OP(0xa0):   //ANA B
+                    And(state, state->b);
+                    NEXT;
+        OP(0xa1):   //ANA C
+                    And(state, state->c);
+                    NEXT;
+        OP(0xa2):   //ANA D
+                    And(state, state->d);
+                    NEXT;
+        OP(0xa3):   //ANA E
+                    And(state, state->e);
+                    NEXT;
+        OP(0xa4):   //ANA H
+                    And(state, state->h);
+                    NEXT;
+        OP(0xa5):   //ANA L
+                    And(state, state->l);
+                    NEXT;
+        OP(0xa6):   //ANA M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    And(state, state->memory[x]);
+                    }
+                    NEXT;
+        OP(0xa7):   //ANA A
+                    And(state, state->a);
+                    NEXT;
+        OP(0xa8):   //XRA B
+                    state->a ^= state->b;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xa9):   //XRA C
+                    state->a ^= state->c;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xaa):   //XRA D
+                    state->a ^= state->d;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xab):   //XRA E
+                    state->a ^= state->e;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xac):   //XRA H
+                    state->a ^= state->h;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xad):   //XRA L
+                    state->a ^= state->l;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xae):   //XRA M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->a ^= state->memory[x];
+                    LogicFlags(state);
+                    }
+                    NEXT;
+        OP(0xaf):   //XRA A
+                    {
+                    state->a = state->a^state->a;
+                    LogicFlags(state);
+                    }
+                    NEXT;
+        OP(0xb0):   //ORA B
+                    state->a |= state->b;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb1):   //ORA C
+                    state->a |= state->c;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb2):   //ORA D
+                    state->a |= state->d;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb3):   //ORA E
+                    state->a |= state->e;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb4):   //ORA H
+                    state->a |= state->h;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb5):   //ORA L
+                    state->a |= state->l;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb6):   //ORA M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    state->a |= state->memory[x];
+                    LogicFlags(state);
+                    }
+                    NEXT;
+        OP(0xb7):   //ORA A
+                    state->a |= state->a;
+                    LogicFlags(state);
+                    NEXT;
+        OP(0xb8):   //CMP B
+                    Compare(state, state->b);
+                    NEXT;
+        OP(0xb9):   //CMP C
+                    Compare(state, state->c);
+                    NEXT;
+        OP(0xba):   //CMP D
+                    Compare(state, state->d);
+                    NEXT;
+        OP(0xbb):   //CMP E
+                    Compare(state, state->e);
+                    NEXT;
+        OP(0xbc):   //CMP H
+                    Compare(state, state->h);
+                    NEXT;
+        OP(0xbd):   //CMP L
+                    Compare(state, state->l);
+                    NEXT;
+        OP(0xbe):   //CMP M
+                    {
+                    uint16_t x = (state->h << 8) | state->l;
+                    Compare(state, state->memory[x]);
+                    }
+                    NEXT;
+        OP(0xbf):   //CMP A
+                    Compare(state, state->a);
+                    NEXT;
+        OP(0xc0):   //RNZ
+                    if (!FlagZ(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xc1):   //POP B
+                    {
+                    state->b = state->memory[(uint16_t) (state->sp+1)];
+                    state->c = state->memory[state->sp];
+                    state->sp +=2;
+                    }
+                    NEXT;
+        OP(0xc2):   //JNZ
+                    {
+                    if (!FlagZ(state)) state->pc = IMM16;
+                    else state->pc += 2; 
+                    }
+                    NEXT;
+        OP(0xc3):   //JMP
+                    {
+                    state->pc = IMM16;
+                    NEXT;
+                    }
+        OP(0xc4):   //CNZ
+                    if (!FlagZ(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xc5):   //PUSH B
+                    {
+                    WriteMem(state, state->sp-2, state->c);
+                    WriteMem(state, state->sp-1, state->b);
+                    state->sp -= 2;
+                    }
+                    NEXT;
+        OP(0xc6):   //ADI
+                    {
+                    Add(state, IMM8, 0);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xc7):   //RST 0
+                    Restart(state, 0x00);
+                    NEXT;
+        OP(0xc8):   //RZ
+                    if (FlagZ(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xc9):   //RET
+                    {
+                    Return(state);
+                    NEXT;
+                    }
+        OP(0xca):   //JZ
+                    {
+                    if (FlagZ(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xcb):   //JMP (undocumented)
+                    state->pc = IMM16;
+                    NEXT;
+        OP(0xcc):   //CZ
+                    if (FlagZ(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xcd):   //CALL 
+                    CallAdr(state, IMM16);
+                    NEXT;
+        OP(0xce):   //ACI
+                    {
+                    Add(state, IMM8, FlagCY(state));
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xcf):   //RST 1
+                    Restart(state, 0x08);
+                    NEXT;
+        OP(0xd0):   //RNC
+                    if (!FlagCY(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xd1):   //POP D
+                    {
+                    state->d = state->memory[(uint16_t) (state->sp+1)];
+                    state->e = state->memory[state->sp];
+                    state->sp +=2;
+                    }
+                    NEXT;
+        OP(0xd2):   //JNC
+                    {
+                    if (!FlagCY(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xd3):   //OUT
+                    {
+                    PortWrite(state, IMM8, state->a);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xd4):   //CNC
+                    if (!FlagCY(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xd5):   //PUSH D
+                    {
+                    WriteMem(state, state->sp -1, state->d);
+                    WriteMem(state, state->sp -2, state->e);
+                    state->sp -= 2; 
+                    }
+                    NEXT;
+        OP(0xd6):   //SUI
+                    {
+                    Subtract(state, IMM8, 0);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xd7):   //RST 2
+                    Restart(state, 0x10);
+                    NEXT;
+        OP(0xd8):   //RC
+                    if (FlagCY(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xd9):   //RET (undocumented)
+                    Return(state);
+                    NEXT;
+        OP(0xda):   //JC
+                    {
+                    if (FlagCY(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xdb):   //IN
+                    {
+                    state->a = PortRead(state, IMM8);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xdc):   //CC
+                    if (FlagCY(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xdd):   //CALL (undocumented)
+                    CallAdr(state, IMM16);
+                    NEXT;
+        OP(0xde):   //SBI
+                    {
+                    Subtract(state, IMM8, FlagCY(state));
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xdf):   //RST 3
+                    Restart(state, 0x18);
+                    NEXT;
+        OP(0xe0):   //RPO
+                    if (!FlagP(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xe1):   //POP H
+                    {
+                    state->h = state->memory[(uint16_t) (state->sp+1)];
+                    state->l = state->memory[state->sp];
+                    state->sp +=2;
+                    }
+                    NEXT;
+        OP(0xe2):   //JPO
+                    {
+                    if (!FlagP(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xe3):   //XTHL
+                    {
+                    uint8_t l = state->memory[state->sp];
+                    uint8_t h = state->memory[(uint16_t) (state->sp+1)];
+                    WriteMem(state, state->sp, state->l);
+                    WriteMem(state, state->sp+1, state->h);
+                    state->l = l;
+                    state->h = h;
+                    }
+                    NEXT;
+        OP(0xe4):   //CPO
+                    if (!FlagP(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xe5):   //PUSH H
+                    {
+                    WriteMem(state, state->sp -1, state-> h);
+                    WriteMem(state, state->sp -2, state->l);
+                    state->sp -= 2;
+                    }
+                    NEXT;
+        OP(0xe6):   //ANI
+                    {
+                    And(state, IMM8);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xe7):   //RST 4
+                    Restart(state, 0x20);
+                    NEXT;
+        OP(0xe8):   //RPE
+                    if (FlagP(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xe9):   //PCHL
+                    state->pc = (state->h << 8) | state->l;
+                    NEXT;
+        OP(0xea):   //JPE
+                    {
+                    if (FlagP(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xeb):   //XCHG
+                    {
+                    uint8_t x = state->d;
+                    uint8_t y = state->e;
+                    state->d = state->h;
+                    state->e = state->l;
+                    state->h = x;
+                    state->l = y;
+                    }
+                    NEXT;
+        OP(0xec):   //CPE
+                    if (FlagP(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xed):   //CALL (undocumented)
+                    CallAdr(state, IMM16);
+                    NEXT;
+        OP(0xee):   //XRI
+                    {
+                    state->a ^= IMM8;
+                    LogicFlags(state);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xef):   //RST 5
+                    Restart(state, 0x28);
+                    NEXT;
+        OP(0xf0):   //RP
+                    if (!FlagS(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xf1):   //POP PSW
+                    {
+                    //the flag byte is S Z 0 AC 0 P 1 CY
+                    state->a = state->memory[(uint16_t) (state->sp+1)];
+                    uint8_t x= state->memory[state->sp];
+                    state->cc.s = (0x80 == (x & 0x80));
+                    state->cc.z = (0x40 == (x & 0x40));
+                    state->cc.ac = (0x10 == (x & 0x10));
+                    state->cc.p = (0x04 == (x & 0x04));
+                    state->cc.cy = (0x01 == (x & 0x01));
+                    state->flag_kind = FLAGS_NONE;
+                    state->sp += 2;   
+                    }
+                    NEXT;
+        OP(0xf2):   //JP
+                    {
+                    if (!FlagS(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xf3):   //DI
+                    state->int_enable = 0;
+                    NEXT;
+        OP(0xf4):   //CP
+                    if (!FlagS(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xf5):   //PUSH PSW
+                    {
+                    WriteMem(state, state->sp-1, state->a);
+                    SyncFlags(state);
+                    uint8_t x = (state->cc.s << 7 |
+                            state->cc.z << 6 |
+                            state->cc.ac << 4 |
+                            state->cc.p << 2 |
+                            0x02 |
+                            state->cc.cy);
+                    WriteMem(state, state->sp-2, x);
+                    state->sp = state->sp - 2;
+                    }
+                    NEXT;
+        OP(0xf6):   //ORI
+                    {
+                    state->a |= IMM8;
+                    LogicFlags(state);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xf7):   //RST 6
+                    Restart(state, 0x30);
+                    NEXT;
+        OP(0xf8):   //RM
+                    if (FlagS(state))
+                    {
+                        Return(state);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    NEXT;
+        OP(0xf9):   //SPHL
+                    state->sp = (state->h << 8) | state->l;
+                    NEXT;
+        OP(0xfa):   //JM
+                    {
+                    if (FlagS(state)) state->pc = IMM16;
+                    else state->pc += 2;
+                    }
+                    NEXT;
+        OP(0xfb):   //EI
+                    state->int_enable = 1;
+                    state->ei_done = state->cycles + 4;
+                    //a waiting interrupt goes in after the next instruction
+                    if (state->int_pending)
+                        STOP();
+                    NEXT;
+        OP(0xfc):   //CM
+                    if (FlagS(state))
+                    {
+                        CallAdr(state, IMM16);
+                        cycles += CONDITIONAL_TAKEN;
+                    }
+                    else
+                        state->pc += 2;
+                    NEXT;
+        OP(0xfd):   //CALL (undocumented)
+                    CallAdr(state, IMM16);
+                    NEXT;
+        OP(0xfe):   //CPI
+                    {
+                    Compare(state, IMM8);
+                    state->pc++;
+                    }
+                    NEXT;
+        OP(0xff):   //RST 7
+                    Restart(state, 0x38);
+                    NEXT;
@@ -0,0 +1,101 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "pool.h"
+
+//jobs [top, bottom) still to run; the owner takes from the bottom,
+//thieves from the top, so the two rarely meet on the same job
+typedef struct Queue{
+    pthread_mutex_t lock;
+    int     top;
+    int     bottom;
+}Queue;
+
+typedef struct Pool{
+    Queue   *queues;
+    int     threads;
+    PoolJob fn;
+    void    *ctx;
+}Pool;
+
+typedef struct Worker{
+    Pool    *pool;
+    int     id;
+}Worker;
+
+static int TakeOwn(Queue *q)
+{
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->top < q->bottom)
+        job = --q->bottom;
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static int Steal(Queue *q)
+{
+    int job = -1;
+    pthread_mutex_lock(&q->lock);
+    if (q->top < q->bottom)
+        job = q->top++;
+    pthread_mutex_unlock(&q->lock);
+    return job;
+}
+
+static void* WorkerMain(void *arg)
+{
+    Worker *w = arg;
+    Pool *pool = w->pool;
+
+    for (;;)
+    {
+        int job = TakeOwn(&pool->queues[w->id]);
+        //no job is ever added, so one empty sweep means we are done
+        for (int i = 1; job < 0 && i < pool->threads; i++)
+            job = Steal(&pool->queues[(w->id + i) % pool->threads]);
+        if (job < 0)
+            break;
+        pool->fn(job, pool->ctx);
+    }
+    return NULL;
+}
+
+int PoolCpuCount(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+void PoolRun(int jobs, int threads, PoolJob fn, void *ctx)
+{
+    if (threads <= 0)
+        threads = PoolCpuCount();
+    if (threads > jobs)
+        threads = jobs > 0 ? jobs : 1;
+
+    Pool pool = { calloc(threads, sizeof(Queue)), threads, fn, ctx };
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *tids = calloc(threads, sizeof(pthread_t));
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_mutex_init(&pool.queues[i].lock, NULL);
+        pool.queues[i].top = (int) ((long) jobs * i / threads);
+        pool.queues[i].bottom = (int) ((long) jobs * (i + 1) / threads);
+        workers[i].pool = &pool;
+        workers[i].id = i;
+    }
+    //the calling thread works as worker 0
+    for (int i = 1; i < threads; i++)
+        pthread_create(&tids[i], NULL, WorkerMain, &workers[i]);
+    WorkerMain(&workers[0]);
+    for (int i = 1; i < threads; i++)
+        pthread_join(tids[i], NULL);
+
+    for (int i = 0; i < threads; i++)
+        pthread_mutex_destroy(&pool.queues[i].lock);
+    free(pool.queues);
+    free(workers);
+    free(tids);
+}
@@ -0,0 +1,14 @@
+#ifndef POOL
+#define POOL
+
+/* Runs fn(job, ctx) for job = 0..jobs-1 on a pool of worker threads.
+   Jobs are dealt out in contiguous runs, one per worker; a worker that
+   empties its own queue steals from the far end of another's. Returns
+   when every job has finished. threads <= 0 uses one per online CPU. */
+
+typedef void (*PoolJob)(int job, void *ctx);
+
+void PoolRun(int jobs, int threads, PoolJob fn, void *ctx);
+int PoolCpuCount(void);
+
+#endif
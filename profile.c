@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profile.h"
+
+//CALL, Ccc, RST and RET, Rcc including the undocumented aliases
+const uint8_t profile_flow[256] = {
+    [0xc4] = PROFILE_CALL_IF, [0xcc] = PROFILE_CALL_IF, [0xd4] = PROFILE_CALL_IF,
+    [0xdc] = PROFILE_CALL_IF, [0xe4] = PROFILE_CALL_IF, [0xec] = PROFILE_CALL_IF,
+    [0xf4] = PROFILE_CALL_IF, [0xfc] = PROFILE_CALL_IF,
+    [0xcd] = PROFILE_CALL, [0xdd] = PROFILE_CALL, [0xed] = PROFILE_CALL, [0xfd] = PROFILE_CALL,
+    [0xc7] = PROFILE_CALL, [0xcf] = PROFILE_CALL, [0xd7] = PROFILE_CALL, [0xdf] = PROFILE_CALL,
+    [0xe7] = PROFILE_CALL, [0xef] = PROFILE_CALL, [0xf7] = PROFILE_CALL, [0xff] = PROFILE_CALL,
+    [0xc0] = PROFILE_RETURN_IF, [0xc8] = PROFILE_RETURN_IF, [0xd0] = PROFILE_RETURN_IF,
+    [0xd8] = PROFILE_RETURN_IF, [0xe0] = PROFILE_RETURN_IF, [0xe8] = PROFILE_RETURN_IF,
+    [0xf0] = PROFILE_RETURN_IF, [0xf8] = PROFILE_RETURN_IF,
+    [0xc9] = PROFILE_RETURN, [0xd9] = PROFILE_RETURN,
+};
+
+Profile8080* ProfileCreate(uint32_t every)
+{
+    Profile8080 *profile = calloc(1, sizeof(Profile8080));
+    profile->every = every ? every : 1;
+    profile->countdown = profile->every;
+    profile->slots = 1024;
+    profile->children = calloc(profile->slots, sizeof(uint32_t));
+    profile->nodes = calloc(profile->slots / 2, sizeof(ProfileNode));
+    profile->nnodes = 1;                //the root
+    return profile;
+}
+
+void ProfileFree(Profile8080 *profile)
+{
+    if (profile == NULL)
+        return;
+    for (int i = 0; i < 0x10000; i++)
+        free((char*) profile->names[i]);
+    free(profile->nodes);
+    free(profile->children);
+    free(profile);
+}
+
+static uint32_t Slot(Profile8080 *profile, uint32_t parent, uint16_t entry)
+{
+    uint32_t h = (parent * 0x9e3779b1u) ^ (entry * 0x85ebca6bu);
+    uint32_t i = (h ^ (h >> 15)) & (profile->slots - 1);
+    for (;;)
+    {
+        uint32_t n = profile->children[i];
+        if (n == 0 || (profile->nodes[n - 1].parent == parent && profile->nodes[n - 1].entry == entry))
+            return i;
+        i = (i + 1) & (profile->slots - 1);
+    }
+}
+
+//the path that calling entry from parent makes, added the first time
+static uint32_t Child(Profile8080 *profile, uint32_t parent, uint16_t entry)
+{
+    uint32_t i = Slot(profile, parent, entry);
+    if (profile->children[i])
+        return profile->children[i] - 1;
+
+    //keep the table at most half full; nodes has room for that many
+    if (profile->nnodes + 1 > profile->slots / 2)
+    {
+        uint32_t *old = profile->children;
+        uint32_t slots = profile->slots;
+        profile->slots *= 2;
+        profile->children = calloc(profile->slots, sizeof(uint32_t));
+        profile->nodes = realloc(profile->nodes, profile->slots / 2 * sizeof(ProfileNode));
+        for (uint32_t k = 0; k < slots; k++)
+            if (old[k])
+            {
+                ProfileNode *n = &profile->nodes[old[k] - 1];
+                profile->children[Slot(profile, n->parent, n->entry)] = old[k];
+            }
+        free(old);
+        i = Slot(profile, parent, entry);
+    }
+    uint32_t node = profile->nnodes++;
+    profile->nodes[node].parent = parent;
+    profile->nodes[node].entry = entry;
+    profile->nodes[node].cycles = 0;
+    profile->children[i] = node + 1;
+    return node;
+}
+
+//state has just entered a routine; its return address is at sp
+static void Push(Profile8080 *profile, State8080 *state)
+{
+    if (profile->depth == PROFILE_DEPTH)
+        return;
+    uint32_t node = Child(profile, profile->node, state->pc);
+    profile->stack[profile->depth].sp = state->sp;
+    profile->stack[profile->depth].node = node;
+    profile->depth++;
+    profile->node = node;
+}
+
+void ProfileFlow(Profile8080 *profile, State8080 *state, uint8_t op, int cycles)
+{
+    switch (profile_flow[op])
+    {
+        case PROFILE_CALL_IF:
+            if (cycles == cycles8080[op])
+                break;
+            //fall through
+        case PROFILE_CALL:
+            Push(profile, state);
+            break;
+        case PROFILE_RETURN_IF:
+            if (cycles == cycles8080[op])
+                break;
+            //fall through
+        case PROFILE_RETURN:
+            //sp has moved past the return address of every frame it left;
+            //measured mod 64K, as a return address at 0xfffe leaves sp at 0
+            while (profile->depth > 0 &&
+                   (uint16_t) (state->sp - profile->stack[profile->depth - 1].sp - 1) < 0x8000)
+                profile->depth--;
+            profile->node = profile->depth ? profile->stack[profile->depth - 1].node : 0;
+            break;
+    }
+}
+
+void ProfileSample(Profile8080 *profile, uint16_t pc, int cycles)
+{
+    profile->countdown = profile->every;
+    profile->hits[pc]++;
+    profile->cycles[pc] += cycles;
+    profile->nodes[profile->node].cycles += cycles;
+}
+
+//Accept8080 has just vectored to an interrupt handler
+void ProfileInterrupt(Profile8080 *profile, State8080 *state)
+{
+    Push(profile, state);
+}
+
+//reads "addr name" lines, as romscan writes; returns how many, or -1
+int ProfileLoadSymbols(Profile8080 *profile, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return -1;
+    char line[256], name[200];
+    unsigned adr;
+    int n = 0;
+    while (fgets(line, sizeof(line), fp))
+        if (sscanf(line, "%x %199s", &adr, name) == 2 && adr <= 0xffff)
+        {
+            free((char*) profile->names[adr]);
+            profile->names[adr] = strdup(name);
+            n++;
+        }
+    fclose(fp);
+    return n;
+}
+
+int ProfileWriteFlat(Profile8080 *profile, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "# pc hits cycles, one instruction in %u sampled\n", profile->every);
+    for (int pc = 0; pc < 0x10000; pc++)
+        if (profile->hits[pc])
+            fprintf(fp, "%04x %llu %llu\n", pc, (unsigned long long) profile->hits[pc],
+                    (unsigned long long) profile->cycles[pc]);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static void PrintPath(FILE *fp, Profile8080 *profile, uint32_t node)
+{
+    if (node == 0)
+    {
+        fprintf(fp, "root");
+        return;
+    }
+    ProfileNode *n = &profile->nodes[node];
+    PrintPath(fp, profile, n->parent);
+    if (profile->names[n->entry])
+        fprintf(fp, ";%s", profile->names[n->entry]);
+    else
+        fprintf(fp, ";sub_%04x", n->entry);
+}
+
+int ProfileWriteFolded(Profile8080 *profile, const char *path)
+{
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL)
+        return -1;
+    for (uint32_t node = 0; node < profile->nnodes; node++)
+        if (profile->nodes[node].cycles)
+        {
+            PrintPath(fp, profile, node);
+            fprintf(fp, " %llu\n", (unsigned long long) profile->nodes[node].cycles);
+        }
+    return fclose(fp) == 0 ? 0 : -1;
+}
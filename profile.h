@@ -0,0 +1,76 @@
+#ifndef PROFILE
+#define PROFILE
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* Guest profiler. Every sampled instruction adds one hit and its cycles
+   to its pc, and its cycles to the current call stack. The stack is a
+   shadow of the guest's: CALL, RST and interrupts push the target with
+   the guest sp that holds the return address, and a return drops every
+   frame whose return address sp has moved past, so code that pops its
+   return address and jumps away doesn't leave the shadow out of step.
+   Stacks are kept as a trie of call paths, one node per distinct path.
+   Calls and returns are followed on every instruction; with every > 1
+   only each every'th instruction is counted, cheap enough to leave on. */
+
+#define PROFILE_DEPTH   64      //deeper calls count toward the frame above
+
+typedef struct ProfileFrame{
+    uint16_t    sp;             //where the return address is
+    uint32_t    node;           //path from the root to this frame
+}ProfileFrame;
+
+typedef struct ProfileNode{
+    uint32_t    parent;
+    uint16_t    entry;          //address called
+    uint64_t    cycles;         //cycles sampled with this path innermost
+}ProfileNode;
+
+typedef struct Profile8080{
+    uint64_t    hits[0x10000];      //samples per pc
+    uint64_t    cycles[0x10000];    //cycles of those samples per pc
+    uint32_t    every;              //count one instruction in every this many
+    uint32_t    countdown;          //instructions until the next sample
+    ProfileFrame stack[PROFILE_DEPTH];
+    int         depth;
+    uint32_t    node;               //the innermost frame's path, 0 is the root
+    ProfileNode *nodes;
+    uint32_t    nnodes;
+    uint32_t    *children;          //hash of (parent, entry) -> node + 1
+    uint32_t    slots;              //size of children, a power of two
+    const char  *names[0x10000];    //symbols for the folded output, or NULL
+}Profile8080;
+
+#define PROFILE_CALL        1
+#define PROFILE_CALL_IF     2   //taken when it cost more than cycles8080
+#define PROFILE_RETURN      3
+#define PROFILE_RETURN_IF   4
+
+extern const uint8_t profile_flow[256];
+
+Profile8080* ProfileCreate(uint32_t every);
+void ProfileFree(Profile8080 *profile);
+void ProfileFlow(Profile8080 *profile, State8080 *state, uint8_t op, int cycles);
+void ProfileSample(Profile8080 *profile, uint16_t pc, int cycles);
+void ProfileInterrupt(Profile8080 *profile, State8080 *state);
+
+//called by the cores after each instruction, like TraceStep
+static inline void ProfileStep(Profile8080 *profile, State8080 *state, uint16_t pc,
+                               const uint8_t *opcode, int cycles)
+{
+    if (profile_flow[opcode[0]])
+        ProfileFlow(profile, state, opcode[0], cycles);
+    if (--profile->countdown == 0)
+        ProfileSample(profile, pc, cycles);
+}
+
+int ProfileLoadSymbols(Profile8080 *profile, const char *path);
+
+/* The flat profile is "pc hits cycles" per sampled pc, the folded one
+   is "outer;...;inner cycles" per call path, as flamegraph.pl reads.
+   Both return 0, or -1 if the file couldn't be written. */
+int ProfileWriteFlat(Profile8080 *profile, const char *path);
+int ProfileWriteFolded(Profile8080 *profile, const char *path);
+
+#endif
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+
+#define MAGIC   "8080RPLY"
+
+static void PutVarint(FILE *fp, uint64_t v)
+{
+    while (v >= 0x80)
+    {
+        fputc((v & 0x7f) | 0x80, fp);
+        v >>= 7;
+    }
+    fputc(v, fp);
+}
+
+static int GetVarint(FILE *fp, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = fgetc(fp);
+        if (c == EOF)
+            return -1;
+        *v |= (uint64_t) (c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return 0;
+    }
+    return -1;
+}
+
+//load the next event; a short or missing one ends the log
+static void ReadEvent(Replay8080 *replay)
+{
+    uint64_t v;
+    replay->pending = 0;
+    if (GetVarint(replay->fp, &v) != 0)
+        return;
+
+    replay->at = replay->last + (v >> 1);
+    replay->interrupt = v & 1;
+    int a = fgetc(replay->fp);
+    int b = replay->interrupt ? 0 : fgetc(replay->fp);
+    if (a == EOF || b == EOF)
+        return;
+    replay->port = a;
+    replay->value = b;
+    replay->pending = 1;
+}
+
+static void WriteEvent(Replay8080 *replay, uint64_t cycles, int interrupt)
+{
+    PutVarint(replay->fp, (cycles - replay->last) << 1 | interrupt);
+    replay->last = cycles;
+}
+
+static void Diverged(State8080* state, const char *what)
+{
+    printf("error: replay diverged at cycle %llu (%s)\n",
+           (unsigned long long) state->cycles, what);
+    exit(1);
+}
+
+Replay8080* ReplayCreate(const char *path, int mode)
+{
+    FILE *fp = fopen(path, mode == REPLAY_RECORD ? "wb" : "rb");
+    if (fp == NULL)
+        return NULL;
+
+    Replay8080 *replay = calloc(1, sizeof(Replay8080));
+    replay->fp = fp;
+    replay->mode = mode;
+    if (mode == REPLAY_RECORD)
+    {
+        fwrite(MAGIC, 8, 1, fp);
+        fputc(REPLAY_VERSION, fp);
+        return replay;
+    }
+
+    char magic[8];
+    if (fread(magic, 8, 1, fp) != 1 || memcmp(magic, MAGIC, 8) != 0 ||
+        fgetc(fp) != REPLAY_VERSION)
+    {
+        ReplayFree(replay);
+        return NULL;
+    }
+    ReadEvent(replay);
+    return replay;
+}
+
+void ReplayFree(Replay8080 *replay)
+{
+    if (replay == NULL)
+        return;
+    fclose(replay->fp);
+    free(replay);
+}
+
+//pushes a recording's buffered events to the log, so a crash keeps them
+void ReplayFlush(Replay8080 *replay)
+{
+    fflush(replay->fp);
+}
+
+/* Stands in for every IN handler. Recording logs what the device
+   returned; playing back returns the logged value instead, or the
+   device's once the log has run out. */
+static uint8_t ReplayIn(void *ctx, uint8_t port)
+{
+    Replay8080 *replay = ctx;
+    State8080* state = replay->state;
+    uint8_t value = replay->in[port](replay->in_ctx[port], port);
+
+    if (replay->mode == REPLAY_RECORD)
+    {
+        WriteEvent(replay, state->cycles, 0);
+        fputc(port, replay->fp);
+        fputc(value, replay->fp);
+        return value;
+    }
+
+    if (!replay->pending)
+        return value;
+    if (replay->interrupt || replay->at != state->cycles || replay->port != port)
+        Diverged(state, "IN");
+    value = replay->value;
+    replay->last = replay->at;
+    ReadEvent(replay);
+    return value;
+}
+
+//called as the CPU accepts an interrupt, like ReplayIn for IN
+uint8_t ReplayInterrupt(State8080* state, uint8_t rst)
+{
+    Replay8080 *replay = state->replay;
+    if (replay->mode == REPLAY_RECORD)
+    {
+        WriteEvent(replay, state->cycles, 1);
+        fputc(rst, replay->fp);
+        return rst;
+    }
+
+    if (!replay->pending)
+        return rst;
+    if (!replay->interrupt || replay->at != state->cycles)
+        Diverged(state, "interrupt");
+    rst = replay->port;
+    replay->last = replay->at;
+    ReadEvent(replay);
+    return rst;
+}
+
+//attach after the machine's devices are mapped
+void ReplayAttach(State8080* state, Replay8080 *replay)
+{
+    replay->state = state;
+    memcpy(replay->in, state->bus.in, sizeof(replay->in));
+    memcpy(replay->in_ctx, state->bus.in_ctx, sizeof(replay->in_ctx));
+    for (int port = 0; port < 256; port++)
+        PortMapIn(state, port, ReplayIn, replay);
+    state->replay = replay;
+}
+
+//put back the handlers the log was in front of, in a copy of the bus
+void ReplayUnwrap(const Replay8080 *replay, PortBus *bus)
+{
+    memcpy(bus->in, replay->in, sizeof(bus->in));
+    memcpy(bus->in_ctx, replay->in_ctx, sizeof(bus->in_ctx));
+}
+
+void ReplaySeek(Replay8080 *replay, uint64_t cycles)
+{
+    while (replay->pending && replay->at < cycles)
+    {
+        replay->last = replay->at;
+        ReadEvent(replay);
+    }
+}
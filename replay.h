@@ -0,0 +1,54 @@
+#ifndef REPLAY
+#define REPLAY
+
+#include <stdint.h>
+#include <stdio.h>
+#include "emulator.h"
+
+/* Record/replay of everything that reaches the machine from outside:
+   the result of every IN and every interrupt, keyed by the cycle count
+   when it happened. A recording replays bit-for-bit on the same core
+   and ROM set; starting from a snapshot, ReplaySeek skips the events
+   before the snapshot's cycle count.
+
+   ReplayAttach puts the log in front of every IN handler on the bus, so
+   machines that aren't recording pay nothing for it.
+
+   The log streams "8080RPLY", a version byte, then one event after
+   another: a varint of (cycles since the last event << 1 | interrupt),
+   followed by port and value for an IN or the RST number for an
+   interrupt. Playback checks each interrupt the machine accepts
+   against the log, so a run that drifts stops at the first difference. */
+
+#define REPLAY_VERSION  1
+
+enum {
+    REPLAY_RECORD,
+    REPLAY_PLAY,
+};
+
+typedef struct Replay8080{
+    FILE        *fp;
+    int         mode;
+    uint64_t    last;           //cycle count of the last event
+    //next event from the log when playing back
+    int         pending;        //an event is loaded
+    uint64_t    at;
+    uint8_t     interrupt;
+    uint8_t     port;           //or RST number
+    uint8_t     value;
+    //the port handlers the log sits in front of
+    State8080   *state;
+    PortIn      in[256];
+    void        *in_ctx[256];
+}Replay8080;
+
+Replay8080* ReplayCreate(const char *path, int mode);
+void ReplayFree(Replay8080 *replay);
+void ReplayFlush(Replay8080 *replay);
+void ReplayAttach(State8080* state, Replay8080 *replay);
+void ReplayUnwrap(const Replay8080 *replay, PortBus *bus);
+uint8_t ReplayInterrupt(State8080* state, uint8_t rst);
+void ReplaySeek(Replay8080 *replay, uint64_t cycles);
+
+#endif
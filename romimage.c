@@ -0,0 +1,112 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "romimage.h"
+#include "replay.h"
+
+static int SharedFile(void)
+{
+#if defined(__linux__)
+    return memfd_create("8080-rom", 0);
+#else
+    char name[] = "/tmp/8080-romXXXXXX";
+    int fd = mkstemp(name);
+    if (fd >= 0)
+        unlink(name);
+    return fd;
+#endif
+}
+
+RomImage* RomImageCreate(const uint8_t *memory, uint32_t rom_end)
+{
+    int fd = SharedFile();
+    if (fd < 0 || write(fd, memory, 0x10000) != 0x10000)
+    {
+        printf("error: Couldn't create the shared ROM image\n");
+        exit(1);
+    }
+
+    RomImage *rom = calloc(1, sizeof(RomImage));
+    rom->fd = fd;
+    rom->rom_end = rom_end;
+    return rom;
+}
+
+void RomImageFree(RomImage *rom)
+{
+    if (rom == NULL)
+        return;
+    close(rom->fd);
+    free(rom);
+}
+
+State8080* InitializeFromRom(const RomImage *rom)
+{
+    State8080* state = calloc(1, sizeof(State8080));
+    void *memory = mmap(NULL, 0x10000, PROT_READ | PROT_WRITE, MAP_PRIVATE, rom->fd, 0);
+    if (memory == MAP_FAILED)
+    {
+        printf("error: Couldn't map the ROM image\n");
+        exit(1);
+    }
+
+    //a host write that slips past WriteMem faults instead of splitting
+    //the shared page; only whole host pages can be protected
+    long host_page = sysconf(_SC_PAGESIZE);
+    uint32_t protect = rom->rom_end / host_page * host_page;
+    if (protect)
+        mprotect(memory, protect, PROT_READ);
+
+    state->memory = memory;
+    state->memory_mapped = 1;
+    ProtectRom(state, 0, rom->rom_end);
+    PortReset(state);
+    return state;
+}
+
+RomImage* RomImageFork(State8080* parent)
+{
+    uint32_t rom_end = 0;
+    while (rom_end < 0x10000 && (parent->page_flags[rom_end >> 8] & PAGE_ROM))
+        rom_end += 0x100;
+    return RomImageCreate(parent->memory, rom_end);
+}
+
+State8080* Clone8080(const RomImage *image, const State8080* parent)
+{
+    State8080* state = InitializeFromRom(image);
+    const char *from = (const char*) parent;
+    uint8_t *memory = state->memory;
+    uint8_t page_flags[256];
+
+    memcpy(page_flags, state->page_flags, sizeof(page_flags));
+    *state = *parent;
+    state->memory = memory;
+    state->memory_mapped = 1;
+    state->trace = NULL;
+    state->jit = NULL;
+    state->decoded = NULL;
+    state->replay = NULL;
+    state->profile = NULL;
+    state->gdb = NULL;
+    state->breakpoints = NULL;
+    state->trap = TRAP_NONE;
+    memcpy(state->page_flags, page_flags, sizeof(page_flags));
+
+    //devices keep the parent's handlers; ones whose state lives inside
+    //the parent (like the board's io) are pointed at the clone's copy
+    if (parent->replay)
+        ReplayUnwrap(parent->replay, &state->bus);
+    for (int port = 0; port < 256; port++)
+    {
+        const char *in = state->bus.in_ctx[port], *out = state->bus.out_ctx[port];
+        if (in >= from && in < from + sizeof(State8080))
+            state->bus.in_ctx[port] = (char*) state + (in - from);
+        if (out >= from && out < from + sizeof(State8080))
+            state->bus.out_ctx[port] = (char*) state + (out - from);
+    }
+    return state;
+}
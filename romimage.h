@@ -0,0 +1,31 @@
+#ifndef ROMIMAGE
+#define ROMIMAGE
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* A 64K memory image shared by many machines. Each machine maps it
+   copy-on-write, so pages it never writes (the ROM, unused address
+   space) stay shared and only the RAM it touches is private. Addresses
+   below rom_end are ROM: the host pages are read-only and guest stores
+   there are dropped, as on the real board. */
+
+typedef struct RomImage{
+    int         fd;
+    uint32_t    rom_end;
+}RomImage;
+
+RomImage* RomImageCreate(const uint8_t *memory, uint32_t rom_end);
+void RomImageFree(RomImage *rom);
+State8080* InitializeFromRom(const RomImage *rom);
+
+/* Forking a running machine: RomImageFork freezes the parent's memory
+   into an image once, and each Clone8080 maps that image and copies the
+   parent's registers, flags and board state, so a clone costs a mapping
+   and one struct rather than 64K. Clones start without a trace, JIT,
+   predecode cache, profile or debugger; port handlers whose context
+   lives inside the parent State8080 are pointed at the clone's copy. */
+RomImage* RomImageFork(State8080* parent);
+State8080* Clone8080(const RomImage *image, const State8080* parent);
+
+#endif
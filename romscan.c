@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#include "manifest.h"
+#include "cfg.h"
+
+/* Statically analyses ROM images (see cfg.h), one per job on the thread
+   pool, so a corpus of images runs on every core. Each argument is a
+   ROM-set manifest (*.roms) or a raw image loaded at 0. For an image
+   named name.ext it writes, in the output directory,
+       name.map        code and data ranges
+       name.sym        symbols, "addr name"
+       name.dot        the control-flow graph
+       name.calls.dot  the call graph
+       name.blocks     the block map, for emulator -j -b
+   Usage: romscan [-o dir] [-t threads] image... */
+
+typedef struct Scan{
+    char        **paths;
+    const char  *outdir;
+    char        **results;      //summary line per image
+}Scan;
+
+//a raw image at 0; returns its size, or 0 if it couldn't be read
+static uint32_t LoadRaw(const char *path, uint8_t *memory)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return 0;
+    size_t n = fread(memory, 1, 0x10000, fp);
+    fclose(fp);
+    return (uint32_t) n;
+}
+
+static int EndsWith(const char *s, const char *suffix)
+{
+    size_t n = strlen(s), k = strlen(suffix);
+    return n >= k && strcmp(s + n - k, suffix) == 0;
+}
+
+static void ScanImage(int job, void *ctx)
+{
+    Scan *scan = ctx;
+    const char *path = scan->paths[job];
+    char *result = malloc(512);
+    uint8_t *memory = calloc(0x10000, 1);
+    int loaded = EndsWith(path, ".roms") ? LoadManifest(path, memory, 0, NULL)
+                                          : (int) LoadRaw(path, memory);
+    scan->results[job] = result;
+    if (loaded <= 0)
+    {
+        snprintf(result, 512, "%s: error: Couldn't read it", path);
+        free(memory);
+        return;
+    }
+    uint32_t rom_end = loaded;
+
+    //output names drop the directory and the last extension
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    int len = dot && dot != name ? (int) (dot - name) : (int) strlen(name);
+    char base[512], file[600];
+    snprintf(base, sizeof(base), "%s/%.*s", scan->outdir, len, name);
+
+    Cfg8080 *cfg = CfgAnalyse(memory, rom_end);
+    int failed = 0;
+    snprintf(file, sizeof(file), "%s.map", base);
+    failed |= CfgWriteMap(cfg, file);
+    snprintf(file, sizeof(file), "%s.sym", base);
+    failed |= CfgWriteSymbols(cfg, file);
+    snprintf(file, sizeof(file), "%s.dot", base);
+    failed |= CfgWriteGraph(cfg, memory, file);
+    snprintf(file, sizeof(file), "%s.calls.dot", base);
+    failed |= CfgWriteCalls(cfg, file);
+    snprintf(file, sizeof(file), "%s.blocks", base);
+    failed |= CfgWriteBlocks(cfg, file);
+
+    int code = 0, routines = 0;
+    for (uint32_t adr = 0; adr < rom_end; adr++)
+        code += cfg->map[adr] != CFG_DATA;
+    for (uint32_t adr = 0; adr < 0x10000; adr++)
+        routines += (cfg->marks[adr] & (BLOCK_ENTRY | BLOCK_CALLED)) && adr < rom_end &&
+                    cfg->map[adr] == CFG_OPCODE;
+    if (failed)
+        snprintf(result, 512, "%s: error: Couldn't write its output to %s", path, scan->outdir);
+    else
+        snprintf(result, 512, "%s: %u bytes, %d code, %d blocks, %d routines, %d overlaps",
+                 path, rom_end, code, cfg->nblocks, routines, cfg->overlaps);
+    CfgFree(cfg);
+    free(memory);
+}
+
+int main(int argc, char**argv)
+{
+    Scan scan = { malloc(argc * sizeof(char*)), ".", NULL };
+    int threads = 0;
+    int images = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            scan.outdir = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+            scan.paths[images++] = argv[i];
+    }
+    if (images == 0)
+    {
+        printf("usage: romscan [-o dir] [-t threads] image...\n");
+        return 2;
+    }
+
+    scan.results = calloc(images, sizeof(char*));
+    PoolRun(images, threads, ScanImage, &scan);
+
+    int failed = 0;
+    for (int i = 0; i < images; i++)
+    {
+        printf("%s\n", scan.results[i]);
+        failed |= strstr(scan.results[i], ": error: ") != NULL;
+        free(scan.results[i]);
+    }
+    free(scan.results);
+    free(scan.paths);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "snapshot.h"
+
+#define MAGIC       "8080SNAP"
+#define HEADER_SIZE (8 + 1 + 7 + 4 + 2 + 8 + 8 + 6 + 2)
+
+//a run ends after this many unchanged bytes; shorter gaps are stored
+//inline since a run header costs four bytes
+#define RUN_GAP     4
+
+static uint8_t* Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+    return p + 2;
+}
+
+static uint8_t* Put64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (v >> (i * 8)) & 0xff;
+    return p + 8;
+}
+
+static uint16_t Get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint64_t Get64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint8_t BaseByte(const uint8_t *base, uint32_t adr)
+{
+    return base ? base[adr] : 0;
+}
+
+uint8_t* SnapshotSave(State8080* state, const uint8_t *base, size_t *size)
+{
+    //worst case is all of memory differing: a 0xffff-byte run, a 1-byte
+    //run and the terminator; a gap that splits a run skips at least as
+    //many bytes as the header it adds
+    uint8_t *data = malloc(HEADER_SIZE + 0x10000 + 3 * 4);
+    uint8_t *p = data;
+
+    SyncFlags(state);
+    memcpy(p, MAGIC, 8);
+    p += 8;
+    *p++ = SNAPSHOT_VERSION;
+    *p++ = state->a;
+    *p++ = state->b;
+    *p++ = state->c;
+    *p++ = state->d;
+    *p++ = state->e;
+    *p++ = state->h;
+    *p++ = state->l;
+    p = Put16(p, state->sp);
+    p = Put16(p, state->pc);
+    //cc in PSW order: s z 0 ac 0 p 1 cy
+    *p++ = state->cc.s << 7 | state->cc.z << 6 | state->cc.ac << 4 |
+           state->cc.p << 2 | 0x02 | state->cc.cy;
+    *p++ = state->int_enable;
+    p = Put64(p, state->cycles);
+    p = Put64(p, state->instructions);
+    memcpy(p, state->io.in, 3);
+    p[3] = state->io.shift0;
+    p[4] = state->io.shift1;
+    p[5] = state->io.shift_offset;
+    p += 6;
+    //interrupt line: pending, halted, EI just ran; RST number above
+    *p++ = state->int_pending | state->halted << 1 |
+           (state->cycles == state->ei_done) << 2 | state->int_rst << 4;
+    *p++ = 0;
+
+    uint32_t adr = 0;
+    while (adr < 0x10000)
+    {
+        if (state->memory[adr] == BaseByte(base, adr))
+        {
+            adr++;
+            continue;
+        }
+
+        uint32_t end = adr + 1, same = 0;
+        while (end + same < 0x10000 && same < RUN_GAP)
+        {
+            if (state->memory[end + same] == BaseByte(base, end + same))
+                same++;
+            else
+            {
+                end += same + 1;
+                same = 0;
+            }
+        }
+
+        //a full 64K run doesn't fit the length field, so split it
+        if (end - adr > 0xffff)
+            end = adr + 0xffff;
+        p = Put16(p, adr);
+        p = Put16(p, end - adr);
+        memcpy(p, &state->memory[adr], end - adr);
+        p += end - adr;
+        adr = end;
+    }
+    p = Put16(p, 0);
+    p = Put16(p, 0);
+
+    *size = p - data;
+    return data;
+}
+
+int SnapshotLoad(State8080* state, const uint8_t *base, const uint8_t *data, size_t size)
+{
+    if (size < HEADER_SIZE || memcmp(data, MAGIC, 8) != 0 || data[8] != SNAPSHOT_VERSION)
+        return -1;
+
+    //rebuild memory off to the side so a bad snapshot changes nothing
+    uint8_t *memory = malloc(0x10000);
+    if (base)
+        memcpy(memory, base, 0x10000);
+    else
+        memset(memory, 0, 0x10000);
+
+    const uint8_t *p = data + HEADER_SIZE;
+    const uint8_t *end = data + size;
+    for (;;)
+    {
+        if (end - p < 4)
+            goto bad;
+        uint16_t adr = Get16(p);
+        uint16_t len = Get16(p + 2);
+        p += 4;
+        if (len == 0)
+            break;
+        if (end - p < len || adr + len > 0x10000)
+            goto bad;
+        memcpy(&memory[adr], p, len);
+        p += len;
+    }
+
+    //ROM can't be restored into, and a snapshot that differs there
+    //was taken from another ROM set
+    for (uint32_t adr = 0; adr < 0x10000; adr++)
+        if ((state->page_flags[adr >> 8] & PAGE_ROM) && memory[adr] != state->memory[adr])
+            goto bad;
+
+    //stores go through WriteMem so translated and predecoded code
+    //over changed bytes is thrown away
+    for (uint32_t adr = 0; adr < 0x10000; adr++)
+        if (memory[adr] != state->memory[adr])
+            WriteMem(state, adr, memory[adr]);
+    free(memory);
+
+    p = data + 9;
+    state->a = *p++;
+    state->b = *p++;
+    state->c = *p++;
+    state->d = *p++;
+    state->e = *p++;
+    state->h = *p++;
+    state->l = *p++;
+    state->sp = Get16(p);
+    state->pc = Get16(p + 2);
+    p += 4;
+    state->cc.s = (*p >> 7) & 1;
+    state->cc.z = (*p >> 6) & 1;
+    state->cc.ac = (*p >> 4) & 1;
+    state->cc.p = (*p >> 2) & 1;
+    state->cc.cy = *p & 1;
+    p++;
+    state->flag_kind = FLAGS_NONE;
+    state->int_enable = *p++;
+    state->cycles = Get64(p);
+    state->instructions = Get64(p + 8);
+    p += 16;
+    memcpy(state->io.in, p, 3);
+    state->io.shift0 = p[3];
+    state->io.shift1 = p[4];
+    state->io.shift_offset = p[5];
+    p += 6;
+    state->int_pending = *p & 1;
+    state->halted = (*p >> 1) & 1;
+    state->ei_done = (*p & 4) ? state->cycles : 0;
+    state->int_rst = (*p >> 4) & 7;
+    state->stop = 0;
+    return 0;
+
+bad:
+    free(memory);
+    return -1;
+}
+
+int SnapshotSaveFile(State8080* state, const uint8_t *base, const char *path)
+{
+    size_t size;
+    uint8_t *data = SnapshotSave(state, base, &size);
+    FILE *fp = fopen(path, "wb");
+    int ok = fp && fwrite(data, size, 1, fp) == 1;
+
+    if (fp && fclose(fp) != 0)
+        ok = 0;
+    free(data);
+    return ok ? 0 : -1;
+}
+
+int SnapshotLoadFile(State8080* state, const uint8_t *base, const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    fseek(fp, 0L, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+
+    uint8_t *data = malloc(size > 0 ? size : 1);
+    int ret = -1;
+    if (size > 0 && fread(data, size, 1, fp) == 1)
+        ret = SnapshotLoad(state, base, data, size);
+    fclose(fp);
+    free(data);
+    return ret;
+}
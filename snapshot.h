@@ -0,0 +1,25 @@
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <stddef.h>
+#include <stdint.h>
+#include "emulator.h"
+
+/* Save states. A snapshot holds the registers, flags, the interrupt
+   state, the board's shift register and latches, the cycle and instruction counts,
+   and memory as runs of bytes that differ from a base image - normally
+   the machine as loaded from its manifest, so only RAM the game has
+   written is stored. A NULL base means all-zero memory.
+
+   Layout (little-endian): "8080SNAP", version byte, then the fixed
+   header below, then runs of {u16 adr, u16 len, len bytes} ended by a
+   run of length 0. */
+
+#define SNAPSHOT_VERSION    2
+
+uint8_t* SnapshotSave(State8080* state, const uint8_t *base, size_t *size);
+int SnapshotLoad(State8080* state, const uint8_t *base, const uint8_t *data, size_t size);
+int SnapshotSaveFile(State8080* state, const uint8_t *base, const char *path);
+int SnapshotLoadFile(State8080* state, const uint8_t *base, const char *path);
+
+#endif
@@ -0,0 +1,71 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "disasm.h"
+#include "trace.h"
+
+Trace8080* TraceCreate(uint32_t capacity)
+{
+    uint32_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    Trace8080 *trace = calloc(1, sizeof(Trace8080));
+    trace->records = calloc(size, sizeof(TraceRecord));
+    trace->mask = size - 1;
+    return trace;
+}
+
+void TraceFree(Trace8080 *trace)
+{
+    if (trace == NULL)
+        return;
+    free(trace->records);
+    free(trace);
+}
+
+void TraceStep(Trace8080 *trace, State8080 *state, uint16_t pc)
+{
+    TraceRecord *r = &trace->records[trace->count & trace->mask];
+    SyncFlags(state);
+    r->pc = pc;
+    r->sp = state->sp;
+    //an instruction at the top of memory wraps its operands to 0
+    for (int i = 0; i < 3; i++)
+        r->op[i] = state->memory[(uint16_t) (pc + i)];
+    r->flags = state->cc.z |
+               state->cc.s << 1 |
+               state->cc.p << 2 |
+               state->cc.cy << 3 |
+               state->cc.ac << 4;
+    r->a = state->a;
+    r->b = state->b;
+    r->c = state->c;
+    r->d = state->d;
+    r->e = state->e;
+    r->h = state->h;
+    r->l = state->l;
+    trace->count++;
+}
+
+/* Writes the buffered records, oldest first, in the layout Emulate8080
+   used to print inline, to stdout. */
+void TraceDump(Trace8080 *trace)
+{
+    uint64_t n = trace->count;
+    uint64_t first = (n > (uint64_t) trace->mask + 1) ? n - trace->mask - 1 : 0;
+
+    for (uint64_t i = first; i < n; i++)
+    {
+        TraceRecord *r = &trace->records[i & trace->mask];
+        char text[32];
+        Disassemble8080(r->op, sizeof(r->op), text, sizeof(text));
+        printf("%04x\t%s\t%c%c%c%c%c  A $%02x B $%02x C $%02x D $%02x E $%02x H $%02x L $%02x SP %04x\n",
+               r->pc, text,
+               (r->flags & 0x01) ? 'z' : '.',
+               (r->flags & 0x02) ? 's' : '.',
+               (r->flags & 0x04) ? 'p' : '.',
+               (r->flags & 0x08) ? 'c' : '.',
+               (r->flags & 0x10) ? 'a' : '.',
+               r->a, r->b, r->c, r->d, r->e, r->h, r->l, r->sp);
+    }
+}
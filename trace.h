@@ -0,0 +1,37 @@
+#ifndef TRACE
+#define TRACE
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* One executed instruction: the bytes at its pc and the registers,
+   both read after it ran, so an instruction that rewrote its own bytes
+   records the new ones. Fixed at 16 bytes so the ring is a plain array
+   and recording is a handful of stores. */
+typedef struct TraceRecord{
+    uint16_t    pc;
+    uint16_t    sp;
+    uint8_t     op[3];
+    uint8_t     flags;      //z s p cy ac in bits 0..4
+    uint8_t     a;
+    uint8_t     b;
+    uint8_t     c;
+    uint8_t     d;
+    uint8_t     e;
+    uint8_t     h;
+    uint8_t     l;
+    uint8_t     pad;
+}TraceRecord;
+
+typedef struct Trace8080{
+    TraceRecord *records;
+    uint32_t    mask;       //capacity - 1, capacity is a power of two
+    uint64_t    count;      //records written since creation
+}Trace8080;
+
+Trace8080* TraceCreate(uint32_t capacity);
+void TraceFree(Trace8080 *trace);
+void TraceStep(Trace8080 *trace, State8080 *state, uint16_t pc);
+void TraceDump(Trace8080 *trace);
+
+#endif
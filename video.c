@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "manifest.h"
+#include "video.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VIDEO_SIMD  1
+#else
+#define VIDEO_SIMD  0
+#endif
+
+#define COLUMN_BYTES    (VIDEO_HEIGHT / 8)
+#define WHITE           0xffffffffu
+#define BLACK           0xff000000u
+
+/* Column x of video RAM is 32 bytes, bit b of byte k being the pixel
+   k*8+b rows up from the bottom. Upright, that pixel is at
+   (x, 255 - (k*8+b)), so each screen row is one bit from the same byte
+   of every column: a bit transpose, done below 16 or 32 columns at a
+   time by gathering byte k of each and peeling off bit 7 with movemask
+   before shifting the next bit up. */
+
+//any of the n lines from x on marked; n is 1, 16 or 32 and divides x
+static inline int Marked(const uint32_t *lines, int x, int n)
+{
+    if (lines == NULL)
+        return 1;
+    uint32_t w = lines[x / 32];
+    return n == 32 ? w != 0 : (w >> (x & 31)) & ((1u << n) - 1);
+}
+
+#if !VIDEO_SIMD
+static void GrayScalar(const uint8_t *vram, uint8_t *out, const uint32_t *lines)
+{
+    for (int x = 0; x < VIDEO_WIDTH; x++)
+    {
+        if (!Marked(lines, x, 1))
+            continue;
+        for (int y = 0; y < VIDEO_HEIGHT; y++)
+        {
+            int bit = (vram[x * COLUMN_BYTES + y / 8] >> (y & 7)) & 1;
+            out[(VIDEO_HEIGHT - 1 - y) * VIDEO_WIDTH + x] = bit ? 0xff : 0;
+        }
+    }
+}
+
+static void RGBAScalar(const uint8_t *vram, uint32_t *out, const uint32_t *lines)
+{
+    for (int x = 0; x < VIDEO_WIDTH; x++)
+    {
+        if (!Marked(lines, x, 1))
+            continue;
+        for (int y = 0; y < VIDEO_HEIGHT; y++)
+        {
+            int bit = (vram[x * COLUMN_BYTES + y / 8] >> (y & 7)) & 1;
+            out[(VIDEO_HEIGHT - 1 - y) * VIDEO_WIDTH + x] = bit ? WHITE : BLACK;
+        }
+    }
+}
+
+#else
+//byte k of 16 consecutive columns
+static inline __m128i Gather16(const uint8_t *vram, int x, int k)
+{
+    const uint8_t *p = vram + x * COLUMN_BYTES + k;
+    return _mm_setr_epi8(p[0], p[32], p[64], p[96], p[128], p[160], p[192], p[224],
+                         p[256], p[288], p[320], p[352], p[384], p[416], p[448], p[480]);
+}
+
+//16 pixel bits to 16 gray bytes
+static inline __m128i Expand16(uint32_t bits)
+{
+    const __m128i select = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+                                         1, 2, 4, 8, 16, 32, 64, -128);
+    __m128i v = _mm_set_epi64x(((bits >> 8) & 0xff) * 0x0101010101010101ull,
+                               (bits & 0xff) * 0x0101010101010101ull);
+    return _mm_cmpeq_epi8(_mm_and_si128(v, select), select);
+}
+
+//4 pixel bits to 4 RGBA words
+static inline __m128i Expand4(uint32_t bits)
+{
+    const __m128i select = _mm_setr_epi32(1, 2, 4, 8);
+    __m128i v = _mm_and_si128(_mm_set1_epi32(bits), select);
+    return _mm_or_si128(_mm_cmpeq_epi32(v, select), _mm_set1_epi32(BLACK));
+}
+
+static void GraySSE2(const uint8_t *vram, uint8_t *out, const uint32_t *lines)
+{
+    for (int x = 0; x < VIDEO_WIDTH; x += 16)
+    {
+        if (!Marked(lines, x, 16))
+            continue;
+        for (int k = 0; k < COLUMN_BYTES; k++)
+        {
+            __m128i v = Gather16(vram, x, k);
+            for (int b = 7; b >= 0; b--)
+            {
+                uint32_t bits = _mm_movemask_epi8(v);
+                uint8_t *row = out + (VIDEO_HEIGHT - 1 - (k * 8 + b)) * VIDEO_WIDTH + x;
+                _mm_storeu_si128((__m128i*) row, Expand16(bits));
+                v = _mm_add_epi8(v, v);
+            }
+        }
+    }
+}
+
+static void RGBASSE2(const uint8_t *vram, uint32_t *out, const uint32_t *lines)
+{
+    for (int x = 0; x < VIDEO_WIDTH; x += 16)
+    {
+        if (!Marked(lines, x, 16))
+            continue;
+        for (int k = 0; k < COLUMN_BYTES; k++)
+        {
+            __m128i v = Gather16(vram, x, k);
+            for (int b = 7; b >= 0; b--)
+            {
+                uint32_t bits = _mm_movemask_epi8(v);
+                uint32_t *row = out + (VIDEO_HEIGHT - 1 - (k * 8 + b)) * VIDEO_WIDTH + x;
+                for (int q = 0; q < 4; q++)
+                    _mm_storeu_si128((__m128i*) (row + q * 4), Expand4(bits >> (q * 4)));
+                v = _mm_add_epi8(v, v);
+            }
+        }
+    }
+}
+
+#define AVX2    __attribute__((target("avx2")))
+
+//byte k of 32 consecutive columns
+static inline AVX2 __m256i Gather32(const uint8_t *vram, int x, int k)
+{
+    return _mm256_setr_m128i(Gather16(vram, x, k), Gather16(vram, x + 16, k));
+}
+
+static AVX2 void GrayAVX2(const uint8_t *vram, uint8_t *out, const uint32_t *lines)
+{
+    const __m256i select = _mm256_set1_epi64x(0x8040201008040201ull);
+    for (int x = 0; x < VIDEO_WIDTH; x += 32)
+    {
+        if (!Marked(lines, x, 32))
+            continue;
+        for (int k = 0; k < COLUMN_BYTES; k++)
+        {
+            __m256i v = Gather32(vram, x, k);
+            for (int b = 7; b >= 0; b--)
+            {
+                uint32_t bits = _mm256_movemask_epi8(v);
+                uint8_t *row = out + (VIDEO_HEIGHT - 1 - (k * 8 + b)) * VIDEO_WIDTH + x;
+                __m256i p = _mm256_set_epi64x((bits >> 24) * 0x0101010101010101ull,
+                                              ((bits >> 16) & 0xff) * 0x0101010101010101ull,
+                                              ((bits >> 8) & 0xff) * 0x0101010101010101ull,
+                                              (bits & 0xff) * 0x0101010101010101ull);
+                p = _mm256_cmpeq_epi8(_mm256_and_si256(p, select), select);
+                _mm256_storeu_si256((__m256i*) row, p);
+                v = _mm256_add_epi8(v, v);
+            }
+        }
+    }
+}
+
+static AVX2 void RGBAAVX2(const uint8_t *vram, uint32_t *out, const uint32_t *lines)
+{
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i black = _mm256_set1_epi32(BLACK);
+    for (int x = 0; x < VIDEO_WIDTH; x += 32)
+    {
+        if (!Marked(lines, x, 32))
+            continue;
+        for (int k = 0; k < COLUMN_BYTES; k++)
+        {
+            __m256i v = Gather32(vram, x, k);
+            for (int b = 7; b >= 0; b--)
+            {
+                uint32_t bits = _mm256_movemask_epi8(v);
+                uint32_t *row = out + (VIDEO_HEIGHT - 1 - (k * 8 + b)) * VIDEO_WIDTH + x;
+                for (int q = 0; q < 4; q++)
+                {
+                    __m256i p = _mm256_and_si256(_mm256_set1_epi32(bits >> (q * 8)), select);
+                    p = _mm256_or_si256(_mm256_cmpeq_epi32(p, select), black);
+                    _mm256_storeu_si256((__m256i*) (row + q * 8), p);
+                }
+                v = _mm256_add_epi8(v, v);
+            }
+        }
+    }
+}
+#endif
+
+void VideoGray(const uint8_t *memory, uint8_t *out)
+{
+    VideoGrayLines(memory, out, NULL);
+}
+
+void VideoRGBA(const uint8_t *memory, uint32_t *out)
+{
+    VideoRGBALines(memory, out, NULL);
+}
+
+//lines NULL redraws everything
+void VideoGrayLines(const uint8_t *memory, uint8_t *out, const uint32_t *lines)
+{
+    const uint8_t *vram = memory + VIDEO_BASE;
+#if VIDEO_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        GrayAVX2(vram, out, lines);
+    else
+        GraySSE2(vram, out, lines);
+#else
+    GrayScalar(vram, out, lines);
+#endif
+}
+
+void VideoRGBALines(const uint8_t *memory, uint32_t *out, const uint32_t *lines)
+{
+    const uint8_t *vram = memory + VIDEO_BASE;
+#if VIDEO_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        RGBAAVX2(vram, out, lines);
+    else
+        RGBASSE2(vram, out, lines);
+#else
+    RGBAScalar(vram, out, lines);
+#endif
+}
+
+void VideoTrack(State8080* state)
+{
+    for (int page = VIDEO_BASE >> 8; page < 0x40; page++)
+        state->page_flags[page] |= PAGE_DIRTY;
+    for (int i = 0; i < VIDEO_WORDS; i++)
+        state->line_dirty[(VIDEO_BASE >> 10) + i] = 0xffffffff;
+}
+
+//copy out and clear the dirty bits of the video lines
+void VideoTakeDirty(State8080* state, uint32_t *lines)
+{
+    for (int i = 0; i < VIDEO_WORDS; i++)
+    {
+        lines[i] = state->line_dirty[(VIDEO_BASE >> 10) + i];
+        state->line_dirty[(VIDEO_BASE >> 10) + i] = 0;
+    }
+}
+
+int VideoWritePPM(const char *path, const uint8_t *gray)
+{
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+        return -1;
+
+    fprintf(fp, "P6\n%d %d\n255\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+    for (int i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++)
+    {
+        uint8_t rgb[3] = { gray[i], gray[i], gray[i] };
+        fwrite(rgb, 3, 1, fp);
+    }
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static void PutBE32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void WriteChunk(FILE *fp, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t head[8];
+    uint8_t *crcbuf = malloc(len + 4);
+
+    PutBE32(head, len);
+    memcpy(head + 4, type, 4);
+    memcpy(crcbuf, type, 4);
+    if (len)
+        memcpy(crcbuf + 4, data, len);
+    uint8_t crc[4];
+    PutBE32(crc, Crc32(crcbuf, len + 4));
+    fwrite(head, 8, 1, fp);
+    if (len)
+        fwrite(data, len, 1, fp);
+    fwrite(crc, 4, 1, fp);
+    free(crcbuf);
+}
+
+/* 8-bit grayscale PNG. The image data goes out as stored (uncompressed)
+   deflate blocks, one per row, which keeps the writer to a few lines
+   and is still small enough for golden images. */
+int VideoWritePNG(const char *path, const uint8_t *gray)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    const uint32_t rowlen = VIDEO_WIDTH + 1;        //filter byte + pixels
+    const uint32_t size = 2 + VIDEO_HEIGHT * (5 + rowlen) + 4;
+    uint8_t ihdr[13] = { 0 };
+    uint8_t *idat = malloc(size);
+    uint8_t *p = idat;
+    uint32_t a = 1, b = 0;
+
+    FILE *fp = fopen(path, "wb");
+    if (fp == NULL)
+    {
+        free(idat);
+        return -1;
+    }
+
+    PutBE32(ihdr, VIDEO_WIDTH);
+    PutBE32(ihdr + 4, VIDEO_HEIGHT);
+    ihdr[8] = 8;        //bit depth
+    ihdr[9] = 0;        //grayscale
+
+    *p++ = 0x78;        //zlib header, no compression
+    *p++ = 0x01;
+    for (int y = 0; y < VIDEO_HEIGHT; y++)
+    {
+        *p++ = (y == VIDEO_HEIGHT - 1);     //final block
+        *p++ = rowlen & 0xff;
+        *p++ = rowlen >> 8;
+        *p++ = ~rowlen & 0xff;
+        *p++ = (~rowlen >> 8) & 0xff;
+        *p++ = 0;                           //no filter
+        memcpy(p, gray + y * VIDEO_WIDTH, VIDEO_WIDTH);
+        p += VIDEO_WIDTH;
+
+        //adler32 of the filter byte and pixels
+        b = (b + a) % 65521;
+        for (int x = 0; x < VIDEO_WIDTH; x++)
+        {
+            a = (a + gray[y * VIDEO_WIDTH + x]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    PutBE32(p, b << 16 | a);
+    p += 4;
+
+    fwrite(signature, 8, 1, fp);
+    WriteChunk(fp, "IHDR", ihdr, sizeof(ihdr));
+    WriteChunk(fp, "IDAT", idat, p - idat);
+    WriteChunk(fp, "IEND", NULL, 0);
+    free(idat);
+    return fclose(fp) == 0 ? 0 : -1;
+}
@@ -0,0 +1,33 @@
+#ifndef VIDEO
+#define VIDEO
+
+#include <stdint.h>
+#include "emulator.h"
+
+/* Headless renderer for the invaders framebuffer. Video RAM at
+   0x2400-0x3fff holds 224 columns of 256 one-bit pixels, bottom to
+   top, for a monitor mounted on its side; the renderers turn it upright
+   into a 224x256 image, one byte (0 or 255) or one RGBA word per pixel.
+   They use AVX2 or SSE2 where the host has it.
+
+   Each 32-byte column is one line as the CRT scans it. After
+   VideoTrack, stores to video RAM mark their line dirty (PAGE_DIRTY);
+   VideoTakeDirty hands the marks since the last call to the *Lines
+   renderers, which only redo the columns that changed in an image kept
+   from the previous frame. */
+
+#define VIDEO_WIDTH     224
+#define VIDEO_HEIGHT    256
+#define VIDEO_BASE      0x2400
+#define VIDEO_WORDS     (VIDEO_WIDTH / 32)  //32-bit words of line bits
+
+void VideoGray(const uint8_t *memory, uint8_t *out);
+void VideoRGBA(const uint8_t *memory, uint32_t *out);
+void VideoTrack(State8080* state);
+void VideoTakeDirty(State8080* state, uint32_t *lines);
+void VideoGrayLines(const uint8_t *memory, uint8_t *out, const uint32_t *lines);
+void VideoRGBALines(const uint8_t *memory, uint32_t *out, const uint32_t *lines);
+int VideoWritePPM(const char *path, const uint8_t *gray);
+int VideoWritePNG(const char *path, const uint8_t *gray);
+
+#endif